@@ -0,0 +1,250 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "canvas.h"
+#include "city_generator.h"
+#include "executor.h"
+#include "json.h"
+#include "json_flat.h"
+#include "render_builder.h"
+#include "router.h"
+#include "router_builder.h"
+#include "serialize.h"
+#include "transport_catalog.h"
+#include "transport_graph.h"
+
+using namespace std;
+
+struct Options {
+    vector<size_t> stops_counts{100};
+    Benchmark::CityParams params;
+    bool buses_count_set = false;
+    size_t repeat = 3;
+    string output;
+    string generate;
+};
+
+static vector<size_t> ParseCounts(string_view value) {
+    vector<size_t> counts;
+    while (!value.empty()) {
+        const size_t comma = value.find(',');
+        counts.push_back(stoul(string(value.substr(0, comma))));
+        value.remove_prefix(comma == string_view::npos ? value.size() : comma + 1);
+    }
+    return counts;
+}
+
+static Options ParseOptions(int argc, const char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const string_view arg(argv[i]);
+        const size_t eq = arg.find('=');
+        const string_view key = arg.substr(0, eq);
+        const string value(eq == string_view::npos ? "" : arg.substr(eq + 1));
+        if (key == "--stops") {
+            options.stops_counts = ParseCounts(value);
+        } else if (key == "--buses") {
+            options.params.buses_count = stoul(value);
+            options.buses_count_set = true;
+        } else if (key == "--route-length") {
+            options.params.route_length = stoul(value);
+        } else if (key == "--roundtrip-ratio") {
+            options.params.roundtrip_ratio = stod(value);
+        } else if (key == "--requests") {
+            options.params.requests_count = stoul(value);
+        } else if (key == "--seed") {
+            options.params.seed = stoul(value);
+        } else if (key == "--repeat") {
+            options.repeat = stoul(value);
+        } else if (key == "--output") {
+            options.output = value;
+        } else if (key == "--generate") {
+            options.generate = value;
+        } else {
+            throw invalid_argument("unknown option " + string(arg));
+        }
+    }
+    return options;
+}
+
+static string ToString(const Json::Node& node) {
+    ostringstream out;
+    Json::PrintNode(node, out);
+    return out.str();
+}
+
+class Measurements {
+   public:
+    explicit Measurements(size_t repeat) : repeat_(repeat) {}
+
+    // Prepare runs before each timed call, for input that the call consumes.
+    void Measure(const string& name, const function<void()>& func, size_t items = 1, const function<void()>& prepare = nullptr) {
+        double min_ms = 0, total_ms = 0;
+        for (size_t i = 0; i < repeat_; ++i) {
+            if (prepare) {
+                prepare();
+            }
+            const auto start = chrono::steady_clock::now();
+            func();
+            const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            min_ms = i == 0 ? ms : min(min_ms, ms);
+            total_ms += ms;
+        }
+        Json::Dict result{
+            {"iterations", Json::Node(static_cast<int>(repeat_))},
+            {"min_ms", Json::Node(min_ms)},
+            {"mean_ms", Json::Node(total_ms / repeat_)}};
+        if (items > 1) {
+            result["items"] = Json::Node(static_cast<int>(items));
+            result["per_item_us"] = Json::Node(min_ms * 1000 / items);
+        }
+        results_[name] = move(result);
+    }
+
+    Json::Dict TakeResults() {
+        return move(results_);
+    }
+
+   private:
+    size_t repeat_;
+    Json::Dict results_;
+};
+
+static Json::Dict RunCity(const Benchmark::CityParams& params, size_t repeat) {
+    const Benchmark::City city = Benchmark::GenerateCity(params, "");
+    const string make_base_text = ToString(city.make_base);
+    Measurements measurements(repeat);
+
+    measurements.Measure("json_load", [&] {
+        istringstream input(make_base_text);
+        Json::Load(input);
+    });
+    measurements.Measure("json_load_flat", [&] {
+        istringstream input(make_base_text);
+        Json::FlatDocument doc(input);
+    });
+    const auto& make_base = city.make_base.AsMap();
+    const auto& base_requests = make_base.at("base_requests").AsArray();
+    const auto& routing_settings = make_base.at("routing_settings").AsMap();
+    const auto& render_settings = make_base.at("render_settings").AsMap();
+
+    measurements.Measure("catalog", [&] {
+        TransportCatalog::Catalog db(base_requests, routing_settings);
+    });
+    const TransportCatalog::Catalog db(base_requests, routing_settings);
+
+    measurements.Measure("transport_graph", [&] {
+        TransportCatalog::TransportGraph graph(db);
+    });
+    const TransportCatalog::TransportGraph graph(db);
+
+    measurements.Measure("layout", [&] {
+        Svg::RenderBuilder render(db, render_settings);
+    });
+    const Svg::RenderBuilder render(db, render_settings);
+
+    measurements.Measure("router_builder", [&] {
+        Serialize::BuildRouter(graph);
+    });
+    const auto built_routes = Serialize::BuildRouter(graph);
+
+    // The write path of make_base, with the route table streamed to the file row by row.
+    const string base_file = (filesystem::temp_directory_path() / ("benchmark_" + to_string(getpid()) + ".bin")).string();
+    Graph::RouterBuilder::RoutesInternalData routes;
+    measurements.Measure("serialize", [&] {
+        ProtoCatalog::TransportCatalog data;
+        Serialize::SerializeBuses(db, data);
+        Serialize::SerializeStops(db, data);
+        Serialize::SerializeStopsIndex(db, data);
+        Serialize::SerializeGraphInfo(graph, data);
+        Serialize::SerializeRender(render, data);
+        Serialize::SerializeMap(data);
+        Serialize::SerializeTo(data, graph, routes, base_file);
+    }, 1, [&] { routes = built_routes; });
+    string base;
+    {
+        ifstream input(base_file, ios::binary);
+        base.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    filesystem::remove(base_file);
+
+    ProtoCatalog::TransportCatalog data;
+    measurements.Measure("deserialize", [&] {
+        data.Clear();
+        data.ParseFromString(base);
+    });
+
+    measurements.Measure("deserialize_arena", [&] {
+        const auto arena = Serialize::MakeArena();
+        google::protobuf::Arena::CreateMessage<ProtoCatalog::TransportCatalog>(arena.get())->ParseFromString(base);
+    });
+
+    measurements.Measure("canvas", [&] {
+        Svg::Canvas canvas(data);
+    });
+    Graph::Router router(data);
+    Svg::Canvas canvas(data);
+    Executor executor(data, router, canvas);
+
+    map<string, vector<Json::Node>> requests_by_type;
+    for (const auto& request : city.process_requests.AsMap().at("stat_requests").AsArray()) {
+        requests_by_type[request.AsMap().at("type").AsString()].push_back(request);
+    }
+    for (const auto& [type, requests] : requests_by_type) {
+        measurements.Measure("request_" + type, [&] {
+            executor.ExecuteRequests(requests);
+        }, requests.size());
+    }
+
+    return {
+        {"params", Json::Node(Json::Dict{
+                       {"stops", Json::Node(static_cast<int>(params.stops_count))},
+                       {"buses", Json::Node(static_cast<int>(params.buses_count))},
+                       {"route_length", Json::Node(static_cast<int>(params.route_length))},
+                       {"roundtrip_ratio", Json::Node(params.roundtrip_ratio)},
+                       {"requests", Json::Node(static_cast<int>(params.requests_count))},
+                       {"seed", Json::Node(static_cast<int>(params.seed))}})},
+        {"results", Json::Node(measurements.TakeResults())}};
+}
+
+int main(int argc, const char* argv[]) {
+    const Options options = ParseOptions(argc, argv);
+
+    Json::Array cities;
+    for (const size_t stops_count : options.stops_counts) {
+        Benchmark::CityParams params = options.params;
+        params.stops_count = stops_count;
+        if (!options.buses_count_set) {
+            params.buses_count = max<size_t>(1, stops_count / 4);
+        }
+        if (!options.generate.empty()) {
+            const Benchmark::City city = Benchmark::GenerateCity(params, options.generate + ".base");
+            ofstream(options.generate + "_make_base.json") << ToString(city.make_base);
+            ofstream(options.generate + "_process_requests.json") << ToString(city.process_requests);
+            return 0;
+        }
+        cerr << "benchmarking " << stops_count << " stops, " << params.buses_count << " buses\n";
+        cities.push_back(RunCity(params, options.repeat));
+    }
+
+    const Json::Node report(Json::Dict{{"cities", Json::Node(move(cities))}});
+    if (options.output.empty()) {
+        Json::PrintNode(report, cout);
+        cout << '\n';
+    } else {
+        ofstream output(options.output);
+        Json::PrintNode(report, output);
+        output << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "city_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "sphere.h"
+
+namespace Benchmark {
+
+static std::string StopName(size_t id) {
+    return "Stop " + std::to_string(id);
+}
+
+static std::string BusName(size_t id) {
+    return std::to_string(id);
+}
+
+static Json::Dict MakeRenderSettings() {
+    using Json::Node;
+    return {
+        {"width", Node(1200)},
+        {"height", Node(800)},
+        {"padding", Node(50)},
+        {"stop_radius", Node(3)},
+        {"line_width", Node(8)},
+        {"stop_label_font_size", Node(12)},
+        {"stop_label_offset", Node(Json::Array{Node(7), Node(-3)})},
+        {"underlayer_color", Node(Json::Array{Node(255), Node(255), Node(255), Node(0.85)})},
+        {"underlayer_width", Node(3)},
+        {"color_palette", Node(Json::Array{Node("green"), Node(Json::Array{Node(255), Node(160), Node(0)}), Node("red")})},
+        {"bus_label_font_size", Node(18)},
+        {"bus_label_offset", Node(Json::Array{Node(7), Node(15)})},
+        {"layers", Node(Json::Array{Node("bus_lines"), Node("bus_labels"), Node("stop_points"), Node("stop_labels")})},
+        {"outer_margin", Node(150)}};
+}
+
+City GenerateCity(const CityParams& params, const std::string& base_file) {
+    using Json::Node;
+    std::mt19937 generator(params.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // Stops are scattered over a square grid, buses walk between neighbouring cells.
+    const size_t side = std::max<size_t>(1, std::ceil(std::sqrt(params.stops_count)));
+    std::vector<Sphere::Point> positions(params.stops_count);
+    for (size_t i = 0; i < params.stops_count; ++i) {
+        positions[i].latitude = 55.5 + (i / side + unit(generator)) * 0.01;
+        positions[i].longitude = 37.3 + (i % side + unit(generator)) * 0.01;
+    }
+
+    std::vector<Json::Dict> road_distances(params.stops_count);
+    auto link = [&](size_t from, size_t to) {
+        if (from == to || road_distances[from].count(StopName(to))) {
+            return;
+        }
+        const double geo_distance = Sphere::Distance(positions[from], positions[to]);
+        road_distances[from][StopName(to)] = Node(static_cast<int>(std::ceil(geo_distance * (1.1 + 0.4 * unit(generator)))));
+    };
+
+    Json::Array base_requests;
+    std::uniform_int_distribution<size_t> any_stop(0, params.stops_count - 1);
+    std::uniform_int_distribution<int> step(-1, 1);
+    for (size_t bus = 0; bus < params.buses_count && params.stops_count > 1; ++bus) {
+        std::vector<size_t> route{any_stop(generator)};
+        while (route.size() < std::max<size_t>(2, params.route_length)) {
+            const long row = static_cast<long>(route.back() / side) + step(generator);
+            const long column = static_cast<long>(route.back() % side) + step(generator);
+            const long next = row * static_cast<long>(side) + column;
+            if (row < 0 || column < 0 || column >= static_cast<long>(side) || next >= static_cast<long>(params.stops_count) ||
+                next == static_cast<long>(route.back())) {
+                continue;
+            }
+            route.push_back(next);
+        }
+        const bool is_roundtrip = unit(generator) < params.roundtrip_ratio;
+        if (is_roundtrip) {
+            route.push_back(route.front());
+        }
+        Json::Array stops;
+        for (size_t i = 0; i < route.size(); ++i) {
+            stops.emplace_back(StopName(route[i]));
+            if (i + 1 < route.size()) {
+                link(route[i], route[i + 1]);
+                if (!is_roundtrip && unit(generator) < 0.5) {
+                    link(route[i + 1], route[i]);
+                }
+            }
+        }
+        base_requests.push_back(Json::Dict{
+            {"type", Node("Bus")},
+            {"name", Node(BusName(bus))},
+            {"stops", Node(std::move(stops))},
+            {"is_roundtrip", Node(is_roundtrip)}});
+    }
+    for (size_t i = 0; i < params.stops_count; ++i) {
+        base_requests.push_back(Json::Dict{
+            {"type", Node("Stop")},
+            {"name", Node(StopName(i))},
+            {"latitude", Node(positions[i].latitude)},
+            {"longitude", Node(positions[i].longitude)},
+            {"road_distances", Node(std::move(road_distances[i]))}});
+    }
+
+    const Json::Dict serialization_settings{{"file", Node(base_file)}};
+    City city;
+    city.make_base = Json::Dict{
+        {"serialization_settings", Node(serialization_settings)},
+        {"routing_settings", Node(Json::Dict{{"bus_wait_time", Node(6)}, {"bus_velocity", Node(40)}})},
+        {"render_settings", Node(MakeRenderSettings())},
+        {"base_requests", Node(std::move(base_requests))}};
+
+    Json::Array stat_requests;
+    std::uniform_int_distribution<size_t> any_bus(0, std::max<size_t>(1, params.buses_count) - 1);
+    const std::vector<std::string> types{"Bus", "Stop", "Route", "Map"};
+    for (size_t id = 0; id < params.requests_count; ++id) {
+        const std::string& type = types[id % types.size()];
+        Json::Dict request{{"id", Node(static_cast<int>(id))}, {"type", Node(type)}};
+        if (type == "Bus") {
+            request["name"] = Node(BusName(any_bus(generator)));
+        } else if (type == "Stop") {
+            request["name"] = Node(StopName(any_stop(generator)));
+        } else if (type == "Route") {
+            request["from"] = Node(StopName(any_stop(generator)));
+            request["to"] = Node(StopName(any_stop(generator)));
+        }
+        stat_requests.push_back(std::move(request));
+    }
+    city.process_requests = Json::Dict{
+        {"serialization_settings", Node(serialization_settings)},
+        {"stat_requests", Node(std::move(stat_requests))}};
+    return city;
+}
+
+}  // namespace Benchmark
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "json.h"
+
+namespace Benchmark {
+
+struct CityParams {
+    size_t stops_count = 100;
+    size_t buses_count = 25;
+    size_t route_length = 10;
+    double roundtrip_ratio = 0.5;
+    size_t requests_count = 100;
+    uint32_t seed = 1;
+};
+
+struct City {
+    Json::Node make_base;
+    Json::Node process_requests;
+};
+
+// The same params always give the same city, so runs on different releases are comparable.
+City GenerateCity(const CityParams& params, const std::string& base_file);
+
+}  // namespace Benchmark
@@ -3,10 +3,13 @@
 #include <limits.h>
 
 #include <algorithm>
+#include <cmath>
+#include <numeric>
 #include <sstream>
 #include <unordered_set>
 
 #include "sphere.h"
+#include "trace.h"
 
 namespace Svg {
 
@@ -30,202 +33,573 @@ std::map<std::string, const ProtoCatalog::Bus*> ConvertBuses(const ProtoCatalog:
     return buses;
 }
 
-Canvas::Canvas(const ProtoCatalog::TransportCatalog &db_)
-    : db(db_), stops_points(ConvertStops(db_)), buses(ConvertBuses(db_)) {
-    funcs.insert(std::make_pair("bus_lines", &Svg::Canvas::RenderBusesRoutes));
-    funcs.insert(std::make_pair("bus_labels", &Svg::Canvas::RenderBusesLabels));
-    funcs.insert(std::make_pair("stop_points", &Svg::Canvas::RenderStopCircles));
-    funcs.insert(std::make_pair("stop_labels", &Svg::Canvas::RenderStopLabels));
-    ExtractRect();
-    ExtractStopPointSettings();
-    ExtractBusLayerSettings();
-    ExtractStopLayerSettings();
-    ExtractBusLabelTextSettings();
-    ExtractStopLabelTextSettings();
-    ExtractPolylineSettings();
-    drawn_map = DrawMap();
-    base_map.Add(rect);
-}
-
-void Canvas::ExtractRect() {
-    double outer_margin = db.render().outer_margin();
+CanvasStyle::CanvasStyle(const ProtoCatalog::RenderSettings &render)
+    : layers(render.layers().begin(), render.layers().end()) {
+    ExtractRect(render);
+    ExtractStopPointSettings(render);
+    ExtractBusLayerSettings(render);
+    ExtractStopLayerSettings(render);
+    ExtractBusLabelTextSettings(render);
+    ExtractStopLabelTextSettings(render);
+    ExtractPolylineSettings(render);
+}
+
+void CanvasStyle::ExtractRect(const ProtoCatalog::RenderSettings &render) {
+    double outer_margin = render.outer_margin();
     rect.SetXY({-outer_margin, -outer_margin})
-        .SetWidth(db.render().width() + 2 * outer_margin)
-        .SetHeight(db.render().height() + 2 * outer_margin)
-        .SetFillColor(db.render().underlayer_color().color())
+        .SetWidth(render.width() + 2 * outer_margin)
+        .SetHeight(render.height() + 2 * outer_margin)
+        .SetFillColor(render.underlayer_color().color())
         .SetStrokeColor(NoneColor)
         .SetStrokeWidth(1.0);
 }
 
-void Canvas::ExtractStopPointSettings() {
+void CanvasStyle::ExtractStopPointSettings(const ProtoCatalog::RenderSettings &render) {
     stop_point_base
-        .SetRadius(db.render().stop_radius())
+        .SetRadius(render.stop_radius())
         .SetFillColor("white");
 }
 
-void Canvas::ExtractBusLayerSettings() {
-    bus_layer_text.SetOffset(ProtoPointToSvgPoint(db.render().bus_label_offset()))
-        .SetFontSize(db.render().bus_label_font_size())
+void CanvasStyle::ExtractBusLayerSettings(const ProtoCatalog::RenderSettings &render) {
+    bus_layer_text.SetOffset(ProtoPointToSvgPoint(render.bus_label_offset()))
+        .SetFontSize(render.bus_label_font_size())
         .SetFontFamily("Verdana")
         .SetFontWeight("bold")
-        .SetFillColor(db.render().underlayer_color().color())
-        .SetStrokeColor(db.render().underlayer_color().color())
-        .SetStrokeWidth(db.render().underlayer_width())
+        .SetFillColor(render.underlayer_color().color())
+        .SetStrokeColor(render.underlayer_color().color())
+        .SetStrokeWidth(render.underlayer_width())
         .SetStrokeLineCap("round")
         .SetStrokeLineJoin("round");
+}
 
-}  // namespace Svg
-
-void Canvas::ExtractStopLayerSettings() {
-    stop_layer_text.SetOffset(ProtoPointToSvgPoint(db.render().stop_label_offset()))
-        .SetFontSize(static_cast<uint32_t>(db.render().stop_label_font_size()))
+void CanvasStyle::ExtractStopLayerSettings(const ProtoCatalog::RenderSettings &render) {
+    stop_layer_text.SetOffset(ProtoPointToSvgPoint(render.stop_label_offset()))
+        .SetFontSize(static_cast<uint32_t>(render.stop_label_font_size()))
         .SetFontFamily("Verdana")
-        .SetFillColor(db.render().underlayer_color().color())
-        .SetStrokeColor(db.render().underlayer_color().color())
-        .SetStrokeWidth(db.render().underlayer_width())
+        .SetFillColor(render.underlayer_color().color())
+        .SetStrokeColor(render.underlayer_color().color())
+        .SetStrokeWidth(render.underlayer_width())
         .SetStrokeLineCap("round")
         .SetStrokeLineJoin("round");
+}
 
-}  // namespace Svg
-
-void Canvas::ExtractBusLabelTextSettings() {
-    bus_label_text.SetOffset(ProtoPointToSvgPoint(db.render().bus_label_offset()))
-        .SetFontSize(db.render().bus_label_font_size())
+void CanvasStyle::ExtractBusLabelTextSettings(const ProtoCatalog::RenderSettings &render) {
+    bus_label_text.SetOffset(ProtoPointToSvgPoint(render.bus_label_offset()))
+        .SetFontSize(render.bus_label_font_size())
         .SetFontFamily("Verdana")
         .SetFontWeight("bold");
 }
 
-void Canvas::ExtractStopLabelTextSettings() {
-    stop_label_text.SetOffset(ProtoPointToSvgPoint(db.render().stop_label_offset()))
-        .SetFontSize(db.render().stop_label_font_size())
+void CanvasStyle::ExtractStopLabelTextSettings(const ProtoCatalog::RenderSettings &render) {
+    stop_label_text.SetOffset(ProtoPointToSvgPoint(render.stop_label_offset()))
+        .SetFontSize(render.stop_label_font_size())
         .SetFontFamily("Verdana")
         .SetFillColor("black");
 }
 
-void Canvas::ExtractPolylineSettings() {
+void CanvasStyle::ExtractPolylineSettings(const ProtoCatalog::RenderSettings &render) {
     bus_polyline
-        .SetStrokeWidth(db.render().line_width())
+        .SetStrokeWidth(render.line_width())
         .SetStrokeLineCap("round")
         .SetStrokeLineJoin("round");
 }
 
-void Canvas::RenderBusesRoutes(Svg::Document &svg) {
-    for (const auto &[name, bus] : buses) {
-        Svg::Polyline copy_base = bus_polyline;
-        copy_base.SetStrokeColor(db.render().buses_colors().at(name).color());
-        size_t b = bus->end_points(0);
-        size_t len = bus->end_points(1) + 1;
-        for (size_t i = b; i < len; ++i) {
-            copy_base.AddPoint(ProtoPointToSvgPoint(db.render().stops_points().at(bus->route(i))));
-        }
-        for (size_t i = len - 2; !bus->is_rouded() && i >= 0 && i < len; --i) {
-            copy_base.AddPoint(ProtoPointToSvgPoint(db.render().stops_points().at(bus->route(i))));
-        }
-        svg.Add(copy_base);
+Canvas::Canvas(const ProtoCatalog::TransportCatalog &db_, std::shared_ptr<const CanvasStyle> style_)
+    : db(db_), stops_points(ConvertStops(db_)), buses(ConvertBuses(db_)),
+      style(style_ ? std::move(style_) : std::make_shared<const CanvasStyle>(db_.render())) {
+    TRACE_SCOPE("Canvas::Canvas");
+    funcs.insert(std::make_pair("bus_lines", &Svg::Canvas::RenderBusesRoutes));
+    funcs.insert(std::make_pair("bus_labels", &Svg::Canvas::RenderBusesLabels));
+    funcs.insert(std::make_pair("stop_points", &Svg::Canvas::RenderStopCircles));
+    funcs.insert(std::make_pair("stop_labels", &Svg::Canvas::RenderStopLabels));
+    // Names are kept from the base, so that copies of the canvas share them.
+    for (const auto &[_, bus] : buses) {
+        bus_list.emplace_back(&bus->name(), bus);
+    }
+    for (const auto &[name, point] : stops_points) {
+        stop_list.emplace_back(&db.render().stops_points().find(name)->first, point);
+    }
+}
+
+const Canvas::Detail &Canvas::GetDetail() const {
+    std::call_once(shared->detail_once, [this] { shared->detail = BuildDetail(); });
+    return shared->detail;
+}
+
+const std::string &Canvas::GetDrawnMap() const {
+    if (!db.map().empty()) {
+        return db.map();
     }
+    std::call_once(shared->drawn_map_once, [this] { shared->drawn_map = DrawMap(); });
+    return shared->drawn_map;
+}
+
+const std::string &Canvas::GetFadedMap() const {
+    std::call_once(shared->faded_map_once, [this] {
+        static constexpr std::string_view CLOSING_TAG = "</svg>";
+        const std::string &drawn_map = GetDrawnMap();
+        std::ostringstream faded;
+        faded << std::string_view(drawn_map).substr(0, drawn_map.size() - CLOSING_TAG.size());
+        style->rect.Render(faded);
+        shared->faded_map = faded.str();
+    });
+    return shared->faded_map;
 }
 
-void Canvas::RenderStopCircles(Svg::Document &svg) {
-    for (const auto &[name, stop] : stops_points) {
-        svg.Add(stop_point_base.SetCenter(ProtoPointToSvgPoint(*stop)));
+const Canvas::TileIndex &Canvas::GetTileIndex() const {
+    std::call_once(shared->tile_index_once, [this] { shared->tile_index = BuildTileIndex(); });
+    return shared->tile_index;
+}
+
+void Canvas::RenderBusRoute(Svg::Document &svg, uint32_t bus_id) const {
+    const auto &[name, bus] = bus_list[bus_id];
+    const auto &line = GetDetail().bus_lines[bus_id];
+    Svg::Polyline copy_base = style->bus_polyline;
+    copy_base.SetStrokeColor(db.render().buses_colors().at(*name).color());
+    for (const Point &point : line) {
+        copy_base.AddPoint(point);
+    }
+    for (size_t i = line.size() - 1; !bus->is_rouded() && i-- > 0;) {
+        copy_base.AddPoint(line[i]);
     }
+    svg.Add(copy_base);
 }
 
-void Canvas::RenderBusesLabels(Svg::Document &svg) {
-    for (const auto &[name, bus] : buses) {
-        const auto &first_stop = bus->route(bus->end_points(0));
-        const auto &last_stop = bus->route(bus->end_points(1));
-        svg.Add(bus_layer_text
-                    .SetData(name)
-                    .SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(first_stop))));
-        svg.Add(bus_label_text
-                    .SetData(name)
-                    .SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(first_stop)))
-                    .SetFillColor(db.render().buses_colors().at(name).color()));
-        if (!bus->is_rouded() && first_stop != last_stop) {
-            svg.Add(bus_layer_text.SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(last_stop))));
-            svg.Add(bus_label_text.SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(last_stop))));
+static bool Contains(const Canvas::Viewport &area, const ProtoCatalog::Point &point) {
+    return area[0] <= point.x() && point.x() <= area[2] && area[1] <= point.y() && point.y() <= area[3];
+}
+
+void Canvas::RenderBusLabels(Svg::Document &svg, uint32_t bus_id, const Viewport *area) const {
+    const auto &[name, bus] = bus_list[bus_id];
+    Text bus_layer_text = style->bus_layer_text;
+    Text bus_label_text = style->bus_label_text;
+    bus_layer_text.SetData(*name);
+    bus_label_text.SetData(*name).SetFillColor(db.render().buses_colors().at(*name).color());
+    const auto render_at = [&](const std::string &stop) {
+        const auto &point = db.render().stops_points().at(stop);
+        if (area && !Contains(*area, point)) {
+            return;
         }
+        svg.Add(bus_layer_text.SetPoint(ProtoPointToSvgPoint(point)));
+        svg.Add(bus_label_text.SetPoint(ProtoPointToSvgPoint(point)));
+    };
+    const auto &first_stop = bus->route(bus->end_points(0));
+    const auto &last_stop = bus->route(bus->end_points(1));
+    render_at(first_stop);
+    if (!bus->is_rouded() && first_stop != last_stop) {
+        render_at(last_stop);
     }
 }
 
-void Canvas::RenderStopLabels(Svg::Document &svg) {
-    for (const auto &[name, point] : stops_points) {
-        svg.Add(stop_layer_text.SetData(name).SetPoint(ProtoPointToSvgPoint(*point)));
-        svg.Add(stop_label_text.SetData(name).SetPoint(ProtoPointToSvgPoint(*point)));
+void Canvas::RenderStopCircle(Svg::Document &svg, uint32_t stop_id) const {
+    if (!GetDetail().stop_circles[stop_id]) {
+        return;
+    }
+    Circle stop_point_base = style->stop_point_base;
+    svg.Add(stop_point_base.SetCenter(ProtoPointToSvgPoint(*stop_list[stop_id].second)));
+}
+
+void Canvas::RenderStopLabel(Svg::Document &svg, uint32_t stop_id) const {
+    if (!GetDetail().stop_labels[stop_id]) {
+        return;
+    }
+    const auto &[name, point] = stop_list[stop_id];
+    Text stop_layer_text = style->stop_layer_text;
+    Text stop_label_text = style->stop_label_text;
+    svg.Add(stop_layer_text.SetData(*name).SetPoint(ProtoPointToSvgPoint(*point)));
+    svg.Add(stop_label_text.SetData(*name).SetPoint(ProtoPointToSvgPoint(*point)));
+}
+
+void Canvas::RenderBusesRoutes(Svg::Document &svg) const {
+    for (uint32_t id = 0; id < bus_list.size(); ++id) {
+        RenderBusRoute(svg, id);
+    }
+}
+
+void Canvas::RenderStopCircles(Svg::Document &svg) const {
+    for (uint32_t id = 0; id < stop_list.size(); ++id) {
+        RenderStopCircle(svg, id);
+    }
+}
+
+void Canvas::RenderBusesLabels(Svg::Document &svg) const {
+    for (uint32_t id = 0; id < bus_list.size(); ++id) {
+        RenderBusLabels(svg, id);
+    }
+}
+
+void Canvas::RenderStopLabels(Svg::Document &svg) const {
+    for (uint32_t id = 0; id < stop_list.size(); ++id) {
+        RenderStopLabel(svg, id);
     }
 }
 
 void Canvas::DrawRouteBusesPolylines(Document &svg, const BusRoutes &data) {
-    for (const auto &[bus, route] : data) {
-        Svg::Polyline copy_base = bus_polyline;
-        copy_base.SetStrokeColor(db.render().buses_colors().at(bus).color());
-        for (const auto &stop : route) {
-            copy_base.AddPoint(ProtoPointToSvgPoint(db.render().stops_points().at(stop->name())));
+    for (const auto &[bus, points, first, last] : data) {
+        Svg::Polyline copy_base = style->bus_polyline;
+        copy_base.SetStrokeColor(db.render().buses_colors().at(bus->name()).color());
+        for (size_t i = first; i <= last; ++i) {
+            copy_base.AddPoint(ProtoPointToSvgPoint(points->points(i)));
         }
         svg.Add(copy_base);
     }
 }
 
 void Canvas::DrawRouteBusesLabels(Document &svg, const BusRoutes &data) {
-    for (const auto &[bus_name, route] : data) {
-        bus_layer_text.SetData(bus_name);
+    Text bus_layer_text = style->bus_layer_text;
+    Text bus_label_text = style->bus_label_text;
+    for (const auto &[bus, points, first, last] : data) {
+        bus_layer_text.SetData(bus->name());
         bus_label_text
-            .SetData(bus_name)
-            .SetFillColor(db.render().buses_colors().at(bus_name).color());
-        const auto& bus = db.buses().at(bus_name); 
-        const auto& route_first_name = route[0]->name();
-        const auto& route_last_name = route.back()->name();
-        const auto &first_name = bus.route(bus.end_points(0));
-        const auto &last_name = bus.route(bus.end_points(1));
+            .SetData(bus->name())
+            .SetFillColor(db.render().buses_colors().at(bus->name()).color());
+        const auto &route_first_name = bus->route(first);
+        const auto &route_last_name = bus->route(last);
+        const auto &first_name = bus->route(bus->end_points(0));
+        const auto &last_name = bus->route(bus->end_points(1));
         if (route_first_name == first_name || route_first_name == last_name) {
-            svg.Add(bus_layer_text.SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(route_first_name))));
-            svg.Add(bus_label_text.SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(route_first_name))));
+            svg.Add(bus_layer_text.SetPoint(ProtoPointToSvgPoint(points->points(first))));
+            svg.Add(bus_label_text.SetPoint(ProtoPointToSvgPoint(points->points(first))));
         }
         if (route_last_name != route_first_name && (route_last_name == first_name || route_last_name == last_name)) {
-            svg.Add(bus_layer_text.SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(route_last_name))));
-            svg.Add(bus_label_text.SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(route_last_name))));
+            svg.Add(bus_layer_text.SetPoint(ProtoPointToSvgPoint(points->points(last))));
+            svg.Add(bus_label_text.SetPoint(ProtoPointToSvgPoint(points->points(last))));
         }
     }
 }
 
-void Canvas::DrawRouteStopPoints(Document &svg, const Data &data) {
-    for (const auto &[stop, _] : data) {
-        svg.Add(stop_point_base.SetCenter(ProtoPointToSvgPoint(db.render().stops_points().at(stop->name()))));
+void Canvas::DrawRouteStopPoints(Document &svg, const BusRoutes &data) {
+    Circle stop_point_base = style->stop_point_base;
+    for (const auto &[bus, points, first, last] : data) {
+        for (size_t i = first; i <= last; ++i) {
+            svg.Add(stop_point_base.SetCenter(ProtoPointToSvgPoint(points->points(i))));
+        }
     }
 }
 
-void Canvas::DrawRouteStopLabels(Document &svg, const Stops &stops) {
-    for (const auto &stop : stops) {
-        svg.Add(stop_layer_text.SetData(stop).SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(stop))));
-        svg.Add(stop_label_text.SetData(stop).SetPoint(ProtoPointToSvgPoint(db.render().stops_points().at(stop))));
+// A route alternates waits and rides, so the stops to label are the ones every ride starts at
+// and the one the last ride ends at.
+void Canvas::DrawRouteStopLabels(Document &svg, const BusRoutes &data) {
+    Text stop_layer_text = style->stop_layer_text;
+    Text stop_label_text = style->stop_label_text;
+    const auto add_label = [&](const ProtoCatalog::Bus &bus, const ProtoCatalog::BusPoints &points, size_t i) {
+        svg.Add(stop_layer_text.SetData(bus.route(i)).SetPoint(ProtoPointToSvgPoint(points.points(i))));
+        svg.Add(stop_label_text.SetData(bus.route(i)).SetPoint(ProtoPointToSvgPoint(points.points(i))));
+    };
+    for (const auto &[bus, points, first, last] : data) {
+        add_label(*bus, *points, first);
+    }
+    if (!data.empty()) {
+        add_label(*data.back().bus, *data.back().points, data.back().last);
     }
 }
 
-std::string Canvas::DrawRoute(const Stops &stops, const BusRoutes &buses_routes, const Data &data) {
-    Document route_map = base_map;
-    for (const auto &layer : db.render().layers()) {
+std::string Canvas::DrawOverFadedMap(const Document &layers) const {
+    std::ostringstream out;
+    out << GetFadedMap();
+    layers.RenderObjects(out);
+    out << "</svg>";
+    return out.str();
+}
+
+std::string Canvas::DrawRoute(const BusRoutes &buses_routes) {
+    Document route_map;
+    for (const auto &layer : style->layers) {
         if (layer == "bus_lines") {
             DrawRouteBusesPolylines(route_map, buses_routes);
         } else if (layer == "bus_labels") {
             DrawRouteBusesLabels(route_map, buses_routes);
         } else if (layer == "stop_points") {
-            DrawRouteStopPoints(route_map, data);
+            DrawRouteStopPoints(route_map, buses_routes);
         } else if (layer == "stop_labels") {
-            DrawRouteStopLabels(route_map, stops);
+            DrawRouteStopLabels(route_map, buses_routes);
         }
     }
-    std::stringstream out;
-    route_map.Render(out);
-    return out.str();
+    return DrawOverFadedMap(route_map);
+}
+
+std::string Canvas::DrawStops(const std::vector<std::string> &stops) {
+    Document stops_map;
+    for (const auto &layer : style->layers) {
+        if (layer == "stop_points") {
+            Circle stop_point_base = style->stop_point_base;
+            for (const auto &stop : stops) {
+                stops_map.Add(stop_point_base.SetCenter(ProtoPointToSvgPoint(*stops_points.at(stop))));
+            }
+        } else if (layer == "stop_labels") {
+            Text stop_layer_text = style->stop_layer_text;
+            Text stop_label_text = style->stop_label_text;
+            for (const auto &stop : stops) {
+                stops_map.Add(stop_layer_text.SetData(stop).SetPoint(ProtoPointToSvgPoint(*stops_points.at(stop))));
+                stops_map.Add(stop_label_text.SetData(stop).SetPoint(ProtoPointToSvgPoint(*stops_points.at(stop))));
+            }
+        }
+    }
+    return DrawOverFadedMap(stops_map);
+}
+
+// Douglas-Peucker: keeps the ends and, recursively, the farthest point of every part that
+// leaves the tolerance.
+static std::vector<Point> SimplifyPolyline(const std::vector<Point> &points, double tolerance) {
+    if (tolerance <= 0 || points.size() < 3) {
+        return points;
+    }
+    std::vector<bool> kept(points.size());
+    kept.front() = kept.back() = true;
+    std::vector<std::pair<size_t, size_t>> parts{{0, points.size() - 1}};
+    while (!parts.empty()) {
+        const auto [first, last] = parts.back();
+        parts.pop_back();
+        const Point &a = points[first], &b = points[last];
+        const double dx = b.x - a.x, dy = b.y - a.y, length = std::hypot(dx, dy);
+        double max_distance = 0;
+        size_t farthest = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            const Point &p = points[i];
+            const double distance = length > 0 ? std::abs(dx * (p.y - a.y) - dy * (p.x - a.x)) / length
+                                               : std::hypot(p.x - a.x, p.y - a.y);
+            if (distance > max_distance) {
+                max_distance = distance;
+                farthest = i;
+            }
+        }
+        if (max_distance > tolerance) {
+            kept[farthest] = true;
+            parts.push_back({first, farthest});
+            parts.push_back({farthest, last});
+        }
+    }
+    std::vector<Point> result;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (kept[i]) {
+            result.push_back(points[i]);
+        }
+    }
+    return result;
+}
+
+// Boxes on a uniform grid of the given cell size, for greedy placement without overlaps.
+class BoxGrid {
+   public:
+    using Box = std::array<double, 4>;
+
+    explicit BoxGrid(double cell_size) : cell_size_(cell_size) {
+    }
+
+    bool Intersects(const Box &box) const {
+        bool found = false;
+        ForEachCell(box, [&](const auto &cell) {
+            if (const auto it = cells_.find(cell); it != cells_.end()) {
+                for (const Box &other : it->second) {
+                    found = found || (box[0] < other[2] && other[0] < box[2] && box[1] < other[3] && other[1] < box[3]);
+                }
+            }
+        });
+        return found;
+    }
+
+    void Add(const Box &box) {
+        ForEachCell(box, [&](const auto &cell) { cells_[cell].push_back(box); });
+    }
+
+   private:
+    double cell_size_;
+    std::map<std::pair<int64_t, int64_t>, std::vector<Box>> cells_;
+
+    template <typename Callback>
+    void ForEachCell(const Box &box, Callback callback) const {
+        for (int64_t row = std::floor(box[1] / cell_size_); row <= std::floor(box[3] / cell_size_); ++row) {
+            for (int64_t column = std::floor(box[0] / cell_size_); column <= std::floor(box[2] / cell_size_); ++column) {
+                callback(std::pair{column, row});
+            }
+        }
+    }
+};
+
+static size_t CountCharacters(const std::string &text) {
+    return std::count_if(text.begin(), text.end(), [](char c) { return (c & 0xC0) != 0x80; });
+}
+
+Canvas::Detail Canvas::BuildDetail() const {
+    Detail detail;
+    const auto &render = db.render();
+    const double tolerance = render.detail_level();
+    for (const auto &[name, bus] : bus_list) {
+        const auto &points = render.buses_points().at(*name).points();
+        std::vector<Point> line;
+        for (size_t i = bus->end_points(0); i <= bus->end_points(1); ++i) {
+            line.push_back(ProtoPointToSvgPoint(points[i]));
+        }
+        detail.bus_lines.push_back(SimplifyPolyline(line, tolerance));
+    }
+    detail.stop_circles.assign(stop_list.size(), true);
+    detail.stop_labels.assign(stop_list.size(), true);
+    if (tolerance <= 0) {
+        return detail;
+    }
+
+    // Stops on more buses go first, so they keep their points and labels.
+    std::vector<uint32_t> order(stop_list.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) {
+        return db.stops().at(*stop_list[lhs].first).buses_size() > db.stops().at(*stop_list[rhs].first).buses_size();
+    });
+    BoxGrid circles(tolerance);
+    for (const uint32_t id : order) {
+        const Point center = ProtoPointToSvgPoint(*stop_list[id].second);
+        const BoxGrid::Box box{center.x - tolerance / 2, center.y - tolerance / 2, center.x + tolerance / 2, center.y + tolerance / 2};
+        detail.stop_circles[id] = !circles.Intersects(box);
+        if (detail.stop_circles[id]) {
+            circles.Add(box);
+        }
+    }
+    // Label extents are estimated from the font size, with glyphs 0.6 em wide.
+    const double font_size = render.stop_label_font_size();
+    const double halo = render.underlayer_width() / 2;
+    BoxGrid labels(std::max(font_size, tolerance) * 4);
+    for (const uint32_t id : order) {
+        const auto &[name, point] = stop_list[id];
+        const double x = point->x() + render.stop_label_offset().x(), y = point->y() + render.stop_label_offset().y();
+        const BoxGrid::Box box{x - halo, y - font_size - halo, x + 0.6 * font_size * CountCharacters(*name) + halo, y + halo};
+        detail.stop_labels[id] = !labels.Intersects(box);
+        if (detail.stop_labels[id]) {
+            labels.Add(box);
+        }
+    }
+    return detail;
+}
+
+Canvas::TileIndex Canvas::BuildTileIndex() const {
+    TileIndex tile_index;
+    if (stop_list.empty()) {
+        return tile_index;
+    }
+    const auto &render = db.render();
+    Point min{stop_list[0].second->x(), stop_list[0].second->y()}, max = min;
+    for (const auto &[_, point] : stop_list) {
+        min = {std::min(min.x, point->x()), std::min(min.y, point->y())};
+        max = {std::max(max.x, point->x()), std::max(max.y, point->y())};
+    }
+    const double side = std::max({max.x - min.x, max.y - min.y, 1.0});
+    const size_t cells_per_side = std::max<size_t>(1, std::sqrt(static_cast<double>(stop_list.size())));
+    tile_index.origin = min;
+    tile_index.cell_size = side / cells_per_side;
+    tile_index.columns = static_cast<size_t>((max.x - min.x) / tile_index.cell_size) + 1;
+    tile_index.rows = static_cast<size_t>((max.y - min.y) / tile_index.cell_size) + 1;
+    // Objects are matched by their anchor points, the margin covers what is drawn around them.
+    tile_index.margin = std::max({render.line_width() / 2, render.stop_radius(),
+                                  std::abs(render.stop_label_offset().x()) + std::abs(render.stop_label_offset().y()) + render.stop_label_font_size(),
+                                  std::abs(render.bus_label_offset().x()) + std::abs(render.bus_label_offset().y()) + render.bus_label_font_size()}) +
+                         render.underlayer_width() + render.detail_level();
+    tile_index.buses.resize(tile_index.columns * tile_index.rows);
+    tile_index.stops.resize(tile_index.columns * tile_index.rows);
+
+    for (uint32_t id = 0; id < stop_list.size(); ++id) {
+        const auto [column, row] = GetCell(tile_index, ProtoPointToSvgPoint(*stop_list[id].second));
+        tile_index.stops[row * tile_index.columns + column].push_back(id);
+    }
+    for (uint32_t id = 0; id < bus_list.size(); ++id) {
+        const auto &points = render.buses_points().at(*bus_list[id].first).points();
+        const auto &bus = *bus_list[id].second;
+        for (size_t i = bus.end_points(0); i < bus.end_points(1); ++i) {
+            const auto [first_column, first_row] = GetCell(tile_index, ProtoPointToSvgPoint(points[i]));
+            const auto [last_column, last_row] = GetCell(tile_index, ProtoPointToSvgPoint(points[i + 1]));
+            for (size_t row = std::min(first_row, last_row); row <= std::max(first_row, last_row); ++row) {
+                for (size_t column = std::min(first_column, last_column); column <= std::max(first_column, last_column); ++column) {
+                    auto &cell = tile_index.buses[row * tile_index.columns + column];
+                    if (cell.empty() || cell.back() != id) {
+                        cell.push_back(id);
+                    }
+                }
+            }
+        }
+    }
+    return tile_index;
+}
+
+std::pair<size_t, size_t> Canvas::GetCell(const TileIndex &tile_index, Point point) {
+    const auto clamp = [&tile_index](double offset, size_t count) {
+        return static_cast<size_t>(std::clamp(offset / tile_index.cell_size, 0.0, static_cast<double>(count - 1)));
+    };
+    return {clamp(point.x - tile_index.origin.x, tile_index.columns), clamp(point.y - tile_index.origin.y, tile_index.rows)};
+}
+
+const std::string &Canvas::DrawTile(const Viewport &viewport) {
+    if (const std::string *tile = tiles.Get(viewport)) {
+        return *tile;
+    }
+    std::vector<uint32_t> visible_buses, visible_stops;
+    const TileIndex &tile_index = GetTileIndex();
+    const double margin = tile_index.margin;
+    const Viewport area{viewport[0] - margin, viewport[1] - margin, viewport[2] + margin, viewport[3] + margin};
+    if (!stop_list.empty()) {
+        const auto crosses = [&area](const ProtoCatalog::Point &lhs, const ProtoCatalog::Point &rhs) {
+            return std::max(lhs.x(), rhs.x()) >= area[0] && std::min(lhs.x(), rhs.x()) <= area[2] &&
+                   std::max(lhs.y(), rhs.y()) >= area[1] && std::min(lhs.y(), rhs.y()) <= area[3];
+        };
+        const auto [first_column, first_row] = GetCell(tile_index, {area[0], area[1]});
+        const auto [last_column, last_row] = GetCell(tile_index, {area[2], area[3]});
+        std::vector<bool> seen_buses(bus_list.size());
+        for (size_t row = first_row; row <= last_row; ++row) {
+            for (size_t column = first_column; column <= last_column; ++column) {
+                const size_t cell = row * tile_index.columns + column;
+                for (const uint32_t id : tile_index.stops[cell]) {
+                    if (Contains(area, *stop_list[id].second)) {
+                        visible_stops.push_back(id);
+                    }
+                }
+                for (const uint32_t id : tile_index.buses[cell]) {
+                    if (seen_buses[id]) {
+                        continue;
+                    }
+                    seen_buses[id] = true;
+                    const auto &points = db.render().buses_points().at(*bus_list[id].first).points();
+                    const auto &bus = *bus_list[id].second;
+                    for (size_t i = bus.end_points(0); i < bus.end_points(1); ++i) {
+                        if (crosses(points[i], points[i + 1])) {
+                            visible_buses.push_back(id);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        std::sort(visible_buses.begin(), visible_buses.end());
+        std::sort(visible_stops.begin(), visible_stops.end());
+    }
+
+    Document tile;
+    for (const auto &layer : style->layers) {
+        if (layer == "bus_lines") {
+            for (const uint32_t id : visible_buses) {
+                RenderBusRoute(tile, id);
+            }
+        } else if (layer == "bus_labels") {
+            for (const uint32_t id : visible_buses) {
+                RenderBusLabels(tile, id, &area);
+            }
+        } else if (layer == "stop_points") {
+            for (const uint32_t id : visible_stops) {
+                RenderStopCircle(tile, id);
+            }
+        } else if (layer == "stop_labels") {
+            for (const uint32_t id : visible_stops) {
+                RenderStopLabel(tile, id);
+            }
+        }
+    }
+    std::ostringstream out;
+    tile.Render(out);
+    return tiles.Put(viewport, out.str());
 }
 
-std::string Canvas::DrawMap() {
-    for (const auto &layer : db.render().layers()) {
-        (this->*funcs.at(layer))(base_map);
+std::string Canvas::DrawMap() const {
+    Document map;
+    for (const auto &layer : style->layers) {
+        (this->*funcs.at(layer))(map);
     }
     std::ostringstream out;
-    base_map.Render(out);
+    map.Render(out);
     return out.str();
 }
 };  // namespace Svg
\ No newline at end of file
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -9,70 +12,130 @@
 #include <vector>
 
 #include "json.h"
+#include "lru_cache.h"
 #include "svg.h"
 #include "transport_catalog.pb.h"
 
 namespace Svg {
+// Element templates derived from the render settings. They do not depend on the city data, so
+// canvases with the same settings can share one style.
+struct CanvasStyle {
+    explicit CanvasStyle(const ProtoCatalog::RenderSettings& render);
+
+    Circle stop_point_base;
+    Text bus_layer_text;
+    Text stop_layer_text;
+    Text bus_label_text;
+    Text stop_label_text;
+    Polyline bus_polyline;
+    Rect rect;
+    std::vector<std::string> layers;
+
+   private:
+    void ExtractRect(const ProtoCatalog::RenderSettings& render);
+    void ExtractStopPointSettings(const ProtoCatalog::RenderSettings& render);
+    void ExtractBusLayerSettings(const ProtoCatalog::RenderSettings& render);
+    void ExtractStopLayerSettings(const ProtoCatalog::RenderSettings& render);
+    void ExtractBusLabelTextSettings(const ProtoCatalog::RenderSettings& render);
+    void ExtractStopLabelTextSettings(const ProtoCatalog::RenderSettings& render);
+    void ExtractPolylineSettings(const ProtoCatalog::RenderSettings& render);
+};
+
 class Canvas {
    public:
-    struct StopBusPair {
-        const ProtoCatalog::Stop* stop;
-        const ProtoCatalog::Bus* bus;
-    };
-
+    // Ride from route position first to route position last of the bus, both inclusive.
     struct BusRoute {
-        std::string busname;
-        std::vector<const ProtoCatalog::Stop*> stops;
+        const ProtoCatalog::Bus* bus;
+        const ProtoCatalog::BusPoints* points;
+        size_t first;
+        size_t last;
     };
 
-    using Stops = std::vector<std::string>;
     using BusRoutes = std::vector<BusRoute>;
-    using Data = std::vector<StopBusPair>;
 
-    Canvas(const ProtoCatalog::TransportCatalog& db);
-    std::string GetDrawnMap() {
-        return drawn_map;
-    }
+    // min x, min y, max x, max y in render coordinates.
+    using Viewport = std::array<double, 4>;
 
-    std::string DrawRoute(const Stops& stops, const BusRoutes& buses_routes, const Data& data);
+    Canvas(const ProtoCatalog::TransportCatalog& db, std::shared_ptr<const CanvasStyle> style = nullptr);
+    // The full map is taken from the base when make_base stored it there, otherwise drawn.
+    const std::string& GetDrawnMap() const;
 
-    Document GetBaseMap() {
-        return base_map;
-    }
+    std::string DrawRoute(const BusRoutes& buses_routes);
+    // Stop points and labels of the given stops over the faded map, as in route maps.
+    std::string DrawStops(const std::vector<std::string>& stops);
+    // The part of the map that can be seen in the viewport: whole bus lines that cross it, stops
+    // inside it and their labels. Recent tiles are cached.
+    const std::string& DrawTile(const Viewport& viewport);
 
    private:
     const ProtoCatalog::TransportCatalog& db;
     std::map<std::string, const ProtoCatalog::Bus*> buses;
     std::map<std::string, const ProtoCatalog::Point*> stops_points;
-    std::string drawn_map;
-    Circle stop_point_base;
-    Text bus_layer_text;
-    Text stop_layer_text;
-    Text bus_label_text;
-    Text stop_label_text;
-    Polyline bus_polyline;
-    Rect rect;
-    Document base_map;
-    std::map<std::string, void (Svg::Canvas::*)(Document& svg)> funcs;
-
-    void ExtractRect();
-    void ExtractStopPointSettings();
-    void ExtractBusLayerSettings();
-    void ExtractStopLayerSettings();
-    void ExtractBusLabelTextSettings();
-    void ExtractStopLabelTextSettings();
-    void ExtractPolylineSettings();
-    std::string DrawMap();
-
-    void RenderBusesRoutes(Document& svg);
-    void RenderStopCircles(Document& svg);
-    void RenderStopLabels(Document& svg);
-    void RenderBusesLabels(Document& svg);
+    std::shared_ptr<const CanvasStyle> style;
+    std::map<std::string, void (Svg::Canvas::*)(Document& svg) const> funcs;
+
+    // Uniform grid over the projected stops. Every cell lists the stops in it and the buses
+    // with a segment whose bounding box touches it.
+    struct TileIndex {
+        Point origin;
+        double cell_size = 1;
+        size_t columns = 0;
+        size_t rows = 0;
+        double margin = 0;
+        std::vector<std::vector<uint32_t>> buses;
+        std::vector<std::vector<uint32_t>> stops;
+    };
+    // Level of detail, by bus and stop ids: simplified bus lines from the first to the last end
+    // point and whether the stop point and the stop label are drawn.
+    struct Detail {
+        std::vector<std::vector<Point>> bus_lines;
+        std::vector<bool> stop_circles;
+        std::vector<bool> stop_labels;
+    };
+    // Parts derived from the base are built on first use and shared by the copies of the canvas,
+    // so server workers hold one of each whatever their number.
+    struct Shared {
+        std::once_flag detail_once;
+        Detail detail;
+        // Only for bases without a stored map.
+        std::once_flag drawn_map_once;
+        std::string drawn_map;
+        // Open svg of the map under the background rect that route maps are drawn over.
+        std::once_flag faded_map_once;
+        std::string faded_map;
+        std::once_flag tile_index_once;
+        TileIndex tile_index;
+    };
+    std::vector<std::pair<const std::string*, const ProtoCatalog::Bus*>> bus_list;
+    std::vector<std::pair<const std::string*, const ProtoCatalog::Point*>> stop_list;
+    std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+    LruCache<Viewport, std::string> tiles{256};
+
+    const Detail& GetDetail() const;
+    const std::string& GetFadedMap() const;
+    const TileIndex& GetTileIndex() const;
+
+    std::string DrawMap() const;
+    std::string DrawOverFadedMap(const Document& layers) const;
+    Detail BuildDetail() const;
+    TileIndex BuildTileIndex() const;
+    static std::pair<size_t, size_t> GetCell(const TileIndex& index, Point point);
+
+    void RenderBusRoute(Document& svg, uint32_t bus_id) const;
+    // With an area only the labels at route ends inside it are rendered.
+    void RenderBusLabels(Document& svg, uint32_t bus_id, const Viewport* area = nullptr) const;
+    void RenderStopCircle(Document& svg, uint32_t stop_id) const;
+    void RenderStopLabel(Document& svg, uint32_t stop_id) const;
+
+    void RenderBusesRoutes(Document& svg) const;
+    void RenderStopCircles(Document& svg) const;
+    void RenderStopLabels(Document& svg) const;
+    void RenderBusesLabels(Document& svg) const;
 
     void DrawRouteBusesPolylines(Document& svg, const BusRoutes& data);
     void DrawRouteBusesLabels(Document& svg, const BusRoutes& data);
-    void DrawRouteStopPoints(Document& svg, const Data& data);
-    void DrawRouteStopLabels(Document& svg, const Stops& stops);
+    void DrawRouteStopPoints(Document& svg, const BusRoutes& data);
+    void DrawRouteStopLabels(Document& svg, const BusRoutes& data);
 };
 
 };  // namespace Svg
\ No newline at end of file
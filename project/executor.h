@@ -1,12 +1,17 @@
 #pragma once
 
+#include <cmath>
 #include <map>
+#include <optional>
 #include <sstream>
 #include <vector>
 
 #include "canvas.h"
 #include "json.h"
+#include "request_stats.h"
 #include "router.h"
+#include "stops_index.h"
+#include "trace.h"
 #include "transport_catalog.pb.h"
 
 struct Executor {
@@ -23,8 +28,22 @@ struct Executor {
     ProtoCatalog::TransportCatalog& data;
     Graph::Router& router;
     Svg::Canvas& canvas;
+    Sphere::StopsIndex stops_index;
+    // Stop names in name order with their wait vertices.
+    std::vector<std::string> stop_names;
+    std::vector<Graph::VertexId> stop_vertices;
+    RequestStats* stats = nullptr;
 
-    Executor(ProtoCatalog::TransportCatalog& data, Graph::Router& router, Svg::Canvas& canvas) : data(data), router(router), canvas(canvas) {
+    Executor(ProtoCatalog::TransportCatalog& data, Graph::Router& router, Svg::Canvas& canvas)
+        : data(data), router(router), canvas(canvas), stops_index(data.stops_index()) {
+        std::map<std::string, Graph::VertexId> vertices;
+        for (const auto& [name, vertex] : data.graph().vertices()) {
+            vertices.emplace(name, vertex.wait());
+        }
+        for (auto& [name, vertex] : vertices) {
+            stop_names.push_back(name);
+            stop_vertices.push_back(vertex);
+        }
     }
 
     Json::Dict ExecuteBusRequest(const std::string& name) {
@@ -76,64 +95,220 @@ struct Executor {
     }
 
     Json::Dict ExecuteRouteRequest(const std::string& from, const std::string& to) {
-        using namespace TransportCatalog;
+        RequestStats::Clock::time_point start;
+        if (stats) start = RequestStats::Clock::now();
         std::optional<Graph::Router::RouteInfo> info = router.BuildRoute(data.graph().vertices().at(from).wait(), data.graph().vertices().at(to).wait());
+        if (stats) {
+            stats->Route().path_us += RequestStats::MicrosecondsSince(start);
+            start = RequestStats::Clock::now();
+        }
         if (info == std::nullopt) return {{"error_message", Json::Node("not found")}};
         Json::Dict res;
         res["total_time"] = info->weight;
         std::vector<Json::Node> items;
-        Svg::Canvas::Data stops_buses;
-        Svg::Canvas::Stops stops;
         Svg::Canvas::BusRoutes buses_routes;
         for (size_t i = 0; i < info->edge_count; ++i) {
             Graph::EdgeId edge_id = router.GetRouteEdge(info->id, i);
             const ProtoCatalog::WaitOrBus& edge = data.graph().edges(edge_id);
             items.push_back(LoadEdge(edge));
-            if (edge.is_wait_edge()) {
-                stops.push_back(edge.wait().stop());
-            } else {
-                std::vector<const ProtoCatalog::Stop*> route_stops;
-                const auto& bus = data.buses().at(edge.bus().bus());
-                for (size_t i = edge.bus().end_points(0); i < edge.bus().end_points(1) + 1; ++i) {
-                    route_stops.push_back(&data.stops().at(bus.route(i)));
-                    stops_buses.push_back({&data.stops().at(bus.route(i)), &data.buses().at(bus.name())});
-                }
-                buses_routes.push_back({bus.name(), std::move(route_stops)});
+            if (!edge.is_wait_edge()) {
+                const auto& bus_edge = edge.bus();
+                buses_routes.push_back({&data.buses().at(bus_edge.bus()), &data.render().buses_points().at(bus_edge.bus()),
+                                        bus_edge.end_points(0), bus_edge.end_points(1)});
             }
         }
-        if (from != to) stops.push_back(to);
-        res["map"] = canvas.DrawRoute(stops, buses_routes, stops_buses);
         res["items"] = Json::Node(items);
         router.ReleaseRoute(info->id);
+        if (stats) {
+            stats->Route().items_us += RequestStats::MicrosecondsSince(start);
+            start = RequestStats::Clock::now();
+        }
+        res["map"] = canvas.DrawRoute(buses_routes);
+        if (stats) stats->Route().render_us += RequestStats::MicrosecondsSince(start);
+        return res;
+    }
+
+    // Total times from every source to every target in one call, null where no route exists.
+    Json::Dict ExecuteRouteMatrixRequest(const std::vector<std::string>& sources, const std::vector<std::string>& targets) {
+        const auto& vertices = data.graph().vertices();
+        std::vector<Graph::VertexId> target_vertices;
+        target_vertices.reserve(targets.size());
+        for (const auto& target : targets) {
+            const auto it = vertices.find(target);
+            if (it == vertices.end()) return {{"error_message", Json::Node("not found")}};
+            target_vertices.push_back(it->second.wait());
+        }
+        std::vector<Json::Node> rows;
+        rows.reserve(sources.size());
+        for (const auto& source : sources) {
+            const auto it = vertices.find(source);
+            if (it == vertices.end()) return {{"error_message", Json::Node("not found")}};
+            std::vector<Json::Node> row;
+            row.reserve(targets.size());
+            for (const auto& weight : router.GetRouteWeights(it->second.wait(), target_vertices)) {
+                row.push_back(weight ? Json::Node(*weight) : Json::Node(nullptr));
+            }
+            rows.emplace_back(std::move(row));
+        }
+        Json::Dict res;
+        res["total_times"] = Json::Node(std::move(rows));
+        return res;
+    }
+
+    // Every stop reachable from the origin within max_time, ordered by time and then by name.
+    Json::Dict ExecuteIsochroneRequest(const std::string& from, double max_time, bool render) {
+        const auto it = data.graph().vertices().find(from);
+        if (it == data.graph().vertices().end()) return {{"error_message", Json::Node("not found")}};
+        const auto weights = router.GetRouteWeights(it->second.wait(), stop_vertices);
+        std::vector<std::pair<double, size_t>> reachable;
+        for (size_t i = 0; i < weights.size(); ++i) {
+            if (weights[i] && *weights[i] <= max_time) {
+                reachable.emplace_back(*weights[i], i);
+            }
+        }
+        std::sort(reachable.begin(), reachable.end());
+        std::vector<Json::Node> stops;
+        std::vector<std::string> names;
+        stops.reserve(reachable.size());
+        for (const auto& [time, i] : reachable) {
+            stops.push_back(Json::Dict{{"name", Json::Node(stop_names[i])}, {"time", Json::Node(time)}});
+            if (render) names.push_back(stop_names[i]);
+        }
+        Json::Dict res;
+        res["stops"] = Json::Node(std::move(stops));
+        if (render) {
+            std::sort(names.begin(), names.end());
+            res["map"] = Json::Node(canvas.DrawStops(names));
+        }
+        return res;
+    }
+
+    template <typename Names>
+    static std::vector<std::string> ReadNames(const Names& names) {
+        std::vector<std::string> result;
+        result.reserve(names.size());
+        for (const auto& name : names) {
+            result.emplace_back(name.AsString());
+        }
+        return result;
+    }
+
+    // Without count every stop within radius is returned, without radius the count nearest ones.
+    Json::Dict ExecuteNearestStopsRequest(Sphere::Point point, std::optional<int> count, std::optional<double> radius) {
+        std::vector<Json::Node> stops;
+        const size_t limit = count ? std::max(*count, 0) : (radius ? data.stops_index().names_size() : 1);
+        for (const auto& [index, distance] : stops_index.FindNearest(point, limit, radius)) {
+            stops.push_back(Json::Dict{{"name", Json::Node(stops_index.GetName(index))}, {"distance", Json::Node(distance)}});
+        }
+        Json::Dict res;
+        res["stops"] = Json::Node(std::move(stops));
         return res;
     }
 
     Json::Dict ExecuteMapRequest() {
         Json::Dict res;
-        res["map"] = Json::Node(canvas.GetDrawnMap());
+        res["map"] = data.map_json().empty() ? Json::Node(canvas.GetDrawnMap()) : Json::Node(Json::Raw{data.map_json()});
         return res;
     }
 
+    Json::Dict ExecuteMapTileRequest(const Svg::Canvas::Viewport& viewport) {
+        Json::Dict res;
+        res["map"] = Json::Node(canvas.DrawTile(viewport));
+        return res;
+    }
+
+    static constexpr int MAX_TILE_ZOOM = 30;
+
+    // A tile is given by its "viewport" [min_x, min_y, max_x, max_y] in map coordinates or by
+    // "zoom", "x" and "y": zoom z splits the map into 2^z by 2^z tiles, numbered from 0. Anything
+    // else is not a tile.
+    template <typename Request>
+    std::optional<Svg::Canvas::Viewport> ReadViewport(const Request& request) const {
+        if (request.count("viewport")) {
+            const auto& node = request.at("viewport");
+            if (!node.IsArray() || node.AsArray().size() != 4) {
+                return std::nullopt;
+            }
+            Svg::Canvas::Viewport viewport;
+            for (size_t i = 0; i < viewport.size(); ++i) {
+                const auto& bound = node.AsArray()[i];
+                if (!bound.IsDouble() || !std::isfinite(bound.AsDouble())) {
+                    return std::nullopt;
+                }
+                viewport[i] = bound.AsDouble();
+            }
+            if (viewport[0] >= viewport[2] || viewport[1] >= viewport[3]) {
+                return std::nullopt;
+            }
+            return viewport;
+        }
+        for (const char* key : {"zoom", "x", "y"}) {
+            if (!request.count(key) || !request.at(key).IsInt()) {
+                return std::nullopt;
+            }
+        }
+        const int zoom = request.at("zoom").AsInt(), x = request.at("x").AsInt(), y = request.at("y").AsInt();
+        if (zoom < 0 || zoom > MAX_TILE_ZOOM) {
+            return std::nullopt;
+        }
+        const int tiles = 1 << zoom;
+        if (x < 0 || x >= tiles || y < 0 || y >= tiles) {
+            return std::nullopt;
+        }
+        const double width = data.render().width() / tiles, height = data.render().height() / tiles;
+        return Svg::Canvas::Viewport{x * width, y * height, (x + 1) * width, (y + 1) * height};
+    }
+
+    // Request is a Json::Dict or a Json::FlatDict.
+    template <typename Request>
+    Json::Node ExecuteRequest(const Request& request) {
+        RequestStats::Clock::time_point start;
+        if (stats) start = RequestStats::Clock::now();
+        Json::Dict dict;
+        const std::string type(request.at("type").AsString());
+        TRACE_SCOPE(type);
+        if (type == "Bus") {
+            dict = ExecuteBusRequest(std::string(request.at("name").AsString()));
+        } else if (type == "Stop") {
+            dict = ExecuteStopRequest(std::string(request.at("name").AsString()));
+        }
+        else if (type == "Route") {
+            dict = ExecuteRouteRequest(std::string(request.at("from").AsString()), std::string(request.at("to").AsString()));
+        } 
+        else if (type == "Map") {
+            dict = ExecuteMapRequest();
+        } else if (type == "MapTile") {
+            if (const auto viewport = ReadViewport(request)) {
+                dict = ExecuteMapTileRequest(*viewport);
+            } else {
+                dict = {{"error_message", Json::Node("invalid tile")}};
+            }
+        } else if (type == "NearestStops") {
+            dict = ExecuteNearestStopsRequest(
+                {request.at("latitude").AsDouble(), request.at("longitude").AsDouble()},
+                request.count("count") ? std::optional<int>(request.at("count").AsInt()) : std::nullopt,
+                request.count("radius") ? std::optional<double>(request.at("radius").AsDouble()) : std::nullopt);
+        } else if (type == "Isochrone") {
+            dict = ExecuteIsochroneRequest(std::string(request.at("from").AsString()), request.at("max_time").AsDouble(),
+                                           request.count("render") && request.at("render").AsBool());
+        } else if (type == "RouteMatrix") {
+            dict = ExecuteRouteMatrixRequest(ReadNames(request.at("sources").AsArray()), ReadNames(request.at("targets").AsArray()));
+        }
+        dict["request_id"] = Json::Node(request.at("id").AsInt());
+        Json::Node result(std::move(dict));
+        if (stats) {
+            // Taken before PrintedSize, which prints the whole response once more.
+            const double latency_us = RequestStats::MicrosecondsSince(start);
+            stats->Record(type, latency_us, RequestStats::PrintedSize(result));
+        }
+        return result;
+    }
+
     std::vector<Json::Node> ExecuteRequests(const std::vector<Json::Node>& requests) {
         std::vector<Json::Node> result;
         result.reserve(requests.size());
         for (const auto& node : requests) {
-            const auto& request = node.AsMap();
-            Json::Dict dict;
-            const auto& type = request.at("type").AsString();
-            if (type == "Bus") {
-                dict = ExecuteBusRequest(request.at("name").AsString());
-            } else if (type == "Stop") {
-                dict = ExecuteStopRequest(request.at("name").AsString());
-            }
-            else if (type == "Route") {
-                dict = ExecuteRouteRequest(request.at("from").AsString(), request.at("to").AsString());
-            } 
-            else if (type == "Map") {
-                dict = ExecuteMapRequest();
-            }
-            dict["request_id"] = Json::Node(request.at("id").AsInt());
-            result.push_back(Json::Node(dict));
+            result.push_back(ExecuteRequest(node.AsMap()));
         }
         return result;
     }
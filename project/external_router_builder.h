@@ -0,0 +1,198 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "graph.h"
+#include "trace.h"
+
+namespace Graph {
+
+// RouterBuilder for tables larger than memory. The table lives in a scratch file, row after
+// row, every row being its weights (infinity when there is no route) followed by its
+// prev_edges. Pivots are taken in blocks that fit the memory budget, and one sequential pass
+// over the file applies a block to every row. Within one pivot every row depends only on
+// itself and on the pivot row, and the pivot row is not changed by its own pivot. So taking
+// each row through the pivots of a block in order, against copies of the pivot rows made at
+// their turn, gives the same table as RouterBuilder, ties included.
+class ExternalRouterBuilder {
+   public:
+    using Graph = DirectedWeightedGraph<double>;
+
+    static constexpr uint32_t NO_EDGE = std::numeric_limits<uint32_t>::max();
+
+    ExternalRouterBuilder(const Graph& graph, size_t memory_budget, const std::filesystem::path& scratch_dir)
+        : vertex_count_(graph.GetVertexCount()),
+          path_(scratch_dir / ("route_table_" + std::to_string(getpid()) + ".tmp")) {
+        file_.open(path_, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file_) {
+            throw std::runtime_error("cannot create " + path_.string());
+        }
+        // The pivot rows of a block, their copies and a chunk of the other rows share the budget.
+        const size_t rows_in_budget = memory_budget / (3 * std::max<size_t>(1, RowBytes()));
+        block_size_ = std::clamp<size_t>(rows_in_budget, 1, std::max<size_t>(1, vertex_count_));
+
+        TRACE_SCOPE("ExternalRouterBuilder");
+        Initialize(graph);
+        const size_t passes = (vertex_count_ + block_size_ - 1) / block_size_;
+        for (size_t pass = 0; pass < passes; ++pass) {
+            TRACE_SCOPE("ExternalRouterBuilder pass");
+            RelaxThroughBlock(pass * block_size_, std::min(vertex_count_, (pass + 1) * block_size_));
+            std::cerr << "router out of core: pass " << pass + 1 << " of " << passes << ", "
+                      << bytes_read_ / (1 << 20) << " MB read, " << bytes_written_ / (1 << 20) << " MB written\n";
+        }
+    }
+
+    ~ExternalRouterBuilder() {
+        file_.close();
+        std::error_code error;
+        std::filesystem::remove(path_, error);
+    }
+
+    size_t GetVertexCount() const {
+        return vertex_count_;
+    }
+
+    // Rows are meant to be read in order, as the base is written.
+    void ReadRow(VertexId row, double* weights, uint32_t* prev_edges) {
+        Rows rows(1, vertex_count_);
+        Read(row, rows);
+        std::copy(rows.weights.begin(), rows.weights.end(), weights);
+        std::copy(rows.prev_edges.begin(), rows.prev_edges.end(), prev_edges);
+    }
+
+   private:
+    struct Rows {
+        Rows(size_t count, size_t vertex_count)
+            : count(count), weights(count * vertex_count), prev_edges(count * vertex_count) {
+        }
+
+        size_t count;
+        std::vector<double> weights;
+        std::vector<uint32_t> prev_edges;
+    };
+
+    size_t vertex_count_;
+    size_t block_size_ = 1;
+    std::filesystem::path path_;
+    std::fstream file_;
+    size_t bytes_read_ = 0;
+    size_t bytes_written_ = 0;
+
+    size_t RowBytes() const {
+        return vertex_count_ * (sizeof(double) + sizeof(uint32_t));
+    }
+
+    void Seek(VertexId first) {
+        file_.seekg(first * RowBytes());
+        file_.seekp(first * RowBytes());
+    }
+
+    void Read(VertexId first, Rows& rows) {
+        Seek(first);
+        for (size_t i = 0; i < rows.count; ++i) {
+            file_.read(reinterpret_cast<char*>(rows.weights.data() + i * vertex_count_), vertex_count_ * sizeof(double));
+            file_.read(reinterpret_cast<char*>(rows.prev_edges.data() + i * vertex_count_), vertex_count_ * sizeof(uint32_t));
+        }
+        if (!file_) {
+            throw std::runtime_error("cannot read " + path_.string());
+        }
+        bytes_read_ += rows.count * RowBytes();
+    }
+
+    void Write(VertexId first, const Rows& rows) {
+        Seek(first);
+        for (size_t i = 0; i < rows.count; ++i) {
+            file_.write(reinterpret_cast<const char*>(rows.weights.data() + i * vertex_count_), vertex_count_ * sizeof(double));
+            file_.write(reinterpret_cast<const char*>(rows.prev_edges.data() + i * vertex_count_), vertex_count_ * sizeof(uint32_t));
+        }
+        if (!file_) {
+            throw std::runtime_error("cannot write " + path_.string());
+        }
+        bytes_written_ += rows.count * RowBytes();
+    }
+
+    void Initialize(const Graph& graph) {
+        Rows row(1, vertex_count_);
+        for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+            std::fill(row.weights.begin(), row.weights.end(), std::numeric_limits<double>::infinity());
+            std::fill(row.prev_edges.begin(), row.prev_edges.end(), NO_EDGE);
+            row.weights[vertex] = 0;
+            for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+                const auto& edge = graph.GetEdge(edge_id);
+                assert(edge.weight >= 0);
+                if (row.weights[edge.to] > edge.weight) {
+                    row.weights[edge.to] = edge.weight;
+                    row.prev_edges[edge.to] = edge_id;
+                }
+            }
+            Write(vertex, row);
+        }
+    }
+
+    // Same steps as RouterBuilder::RelaxRoute for one row and one pivot row.
+    void RelaxRow(double* weights, uint32_t* prev_edges, VertexId through,
+                  const double* through_weights, const uint32_t* through_prev_edges) const {
+        const double weight_from = weights[through];
+        if (weight_from == std::numeric_limits<double>::infinity()) {
+            return;
+        }
+        const uint32_t prev_edge_from = prev_edges[through];
+        for (VertexId to = 0; to < vertex_count_; ++to) {
+            if (through_weights[to] == std::numeric_limits<double>::infinity()) {
+                continue;
+            }
+            const double candidate = weight_from + through_weights[to];
+            if (candidate < weights[to]) {
+                weights[to] = candidate;
+                prev_edges[to] = through_prev_edges[to] != NO_EDGE ? through_prev_edges[to] : prev_edge_from;
+            }
+        }
+    }
+
+    void RelaxThroughBlock(VertexId first, VertexId last) {
+        const size_t width = vertex_count_;
+        Rows block(last - first, width);
+        Rows pivots(last - first, width);
+        Read(first, block);
+        for (VertexId through = first; through < last; ++through) {
+            const size_t pivot = (through - first) * width;
+            std::copy_n(block.weights.begin() + pivot, width, pivots.weights.begin() + pivot);
+            std::copy_n(block.prev_edges.begin() + pivot, width, pivots.prev_edges.begin() + pivot);
+            for (size_t i = 0; i < block.count; ++i) {
+                RelaxRow(block.weights.data() + i * width, block.prev_edges.data() + i * width, through,
+                         pivots.weights.data() + pivot, pivots.prev_edges.data() + pivot);
+            }
+        }
+        Write(first, block);
+
+        const auto relax_chunk = [&](VertexId chunk_first, VertexId chunk_last) {
+            for (VertexId begin = chunk_first; begin < chunk_last; begin += block_size_) {
+                Rows chunk(std::min(block_size_, chunk_last - begin), width);
+                Read(begin, chunk);
+                for (size_t i = 0; i < chunk.count; ++i) {
+                    for (VertexId through = first; through < last; ++through) {
+                        const size_t pivot = (through - first) * width;
+                        RelaxRow(chunk.weights.data() + i * width, chunk.prev_edges.data() + i * width, through,
+                                 pivots.weights.data() + pivot, pivots.prev_edges.data() + pivot);
+                    }
+                }
+                Write(begin, chunk);
+            }
+        };
+        relax_chunk(0, first);
+        relax_chunk(last, vertex_count_);
+    }
+};
+
+}  // namespace Graph
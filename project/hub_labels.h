@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+namespace Graph {
+
+// 2-hop labels built by pruned landmark labeling. Hubs are numbered by the order they were
+// processed in, so every label is sorted by hub as it is built. out_labels[v] holds distances
+// from v to its hubs with the first edge of the path, in_labels[v] holds distances from hubs to v
+// with the last edge of the path. Both trees are closed under these edges, so a path is expanded
+// by following them from label to label.
+struct HubLabelsBuilder {
+    using Graph = DirectedWeightedGraph<double>;
+
+    static constexpr uint32_t NO_EDGE = std::numeric_limits<uint32_t>::max();
+
+    struct Label {
+        std::vector<uint32_t> hubs;
+        std::vector<double> weights;
+        std::vector<uint32_t> edges;
+    };
+
+    HubLabelsBuilder(const Graph& graph)
+        : graph_(graph), incoming_(graph.GetVertexCount()),
+          out_labels(graph.GetVertexCount()), in_labels(graph.GetVertexCount()) {
+        const size_t vertex_count = graph.GetVertexCount();
+        std::vector<size_t> degree(vertex_count);
+        for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+            const auto& edge = graph.GetEdge(edge_id);
+            incoming_[edge.to].push_back(edge_id);
+            ++degree[edge.from];
+            ++degree[edge.to];
+        }
+        order.resize(vertex_count);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&degree](VertexId lhs, VertexId rhs) {
+            return degree[lhs] > degree[rhs];
+        });
+
+        std::vector<double> distances(vertex_count, std::numeric_limits<double>::infinity());
+        std::vector<uint32_t> edges(vertex_count);
+        std::vector<VertexId> visited;
+        for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+            Search<true>(rank, distances, edges, visited);
+            Search<false>(rank, distances, edges, visited);
+        }
+    }
+
+    const Graph& graph_;
+    std::vector<std::vector<EdgeId>> incoming_;
+
+    std::vector<VertexId> order;
+    std::vector<Label> out_labels;
+    std::vector<Label> in_labels;
+
+    static std::optional<double> Query(const Label& out_label, const Label& in_label) {
+        std::optional<double> result;
+        for (size_t i = 0, j = 0; i < out_label.hubs.size() && j < in_label.hubs.size();) {
+            if (out_label.hubs[i] < in_label.hubs[j]) {
+                ++i;
+            } else if (out_label.hubs[i] > in_label.hubs[j]) {
+                ++j;
+            } else {
+                const double weight = out_label.weights[i++] + in_label.weights[j++];
+                if (!result || weight < *result) {
+                    result = weight;
+                }
+            }
+        }
+        return result;
+    }
+
+    // Forward searches go from the hub along edges and fill in_labels, backward searches go
+    // against edges and fill out_labels.
+    template <bool forward>
+    void Search(uint32_t rank, std::vector<double>& distances, std::vector<uint32_t>& edges, std::vector<VertexId>& visited) {
+        constexpr double INF = std::numeric_limits<double>::infinity();
+        const VertexId hub = order[rank];
+        using Item = std::pair<double, VertexId>;
+        std::priority_queue<Item, std::vector<Item>, std::greater<>> queue;
+        distances[hub] = 0;
+        edges[hub] = NO_EDGE;
+        visited.push_back(hub);
+        queue.push({0, hub});
+        while (!queue.empty()) {
+            const auto [distance, vertex] = queue.top();
+            queue.pop();
+            if (distance > distances[vertex]) {
+                continue;
+            }
+            const auto known = forward ? Query(out_labels[hub], in_labels[vertex]) : Query(out_labels[vertex], in_labels[hub]);
+            if (known && *known <= distance) {
+                continue;
+            }
+            Label& label = forward ? in_labels[vertex] : out_labels[vertex];
+            label.hubs.push_back(rank);
+            label.weights.push_back(distance);
+            label.edges.push_back(edges[vertex]);
+
+            const auto relax = [&](EdgeId edge_id) {
+                const auto& edge = graph_.GetEdge(edge_id);
+                const VertexId next = forward ? edge.to : edge.from;
+                const double candidate = distance + edge.weight;
+                if (candidate < distances[next]) {
+                    if (distances[next] == INF) {
+                        visited.push_back(next);
+                    }
+                    distances[next] = candidate;
+                    edges[next] = edge_id;
+                    queue.push({candidate, next});
+                }
+            };
+            if constexpr (forward) {
+                for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                    relax(edge_id);
+                }
+            } else {
+                for (const EdgeId edge_id : incoming_[vertex]) {
+                    relax(edge_id);
+                }
+            }
+        }
+        for (const VertexId vertex : visited) {
+            distances[vertex] = INF;
+        }
+        visited.clear();
+    }
+};
+
+}  // namespace Graph
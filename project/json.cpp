@@ -1,5 +1,7 @@
 #include "json.h"
 
+#include "trace.h"
+
 using namespace std;
 
 namespace Json {
@@ -17,11 +19,15 @@ namespace Json {
     return Node(move(result));
   }
 
+  // Reads true, false and null.
   Node LoadBool(istream& input) {
     string s;
     while (isalpha(input.peek())) {
       s.push_back(input.get());
     }
+    if (s == "null") {
+      return Node(nullptr);
+    }
     return Node(s == "true");
   }
 
@@ -31,6 +37,11 @@ namespace Json {
       is_negative = true;
       input.get();
     }
+    if (!isdigit(input.peek())) {
+      // Not a value at all, so stop the reading instead of returning without progress.
+      input.setstate(ios::failbit);
+      return Node(0);
+    }
     int int_part = 0;
     while (isdigit(input.peek())) {
       int_part *= 10;
@@ -81,7 +92,7 @@ namespace Json {
       return LoadDict(input);
     } else if (c == '"') {
       return LoadString(input);
-    } else if (c == 't' || c == 'f') {
+    } else if (c == 't' || c == 'f' || c == 'n') {
       input.putback(c);
       return LoadBool(input);
     } else {
@@ -91,9 +102,183 @@ namespace Json {
   }
 
   Document Load(istream& input) {
+    TRACE_SCOPE("Json::Load");
     return Document{LoadNode(input)};
   }
 
+  void Builder::StartArray() {
+    stack_.push_back({Array{}, {}});
+  }
+
+  void Builder::StartDict() {
+    stack_.push_back({Dict{}, {}});
+  }
+
+  void Builder::Key(string key) {
+    stack_.back().key = move(key);
+  }
+
+  void Builder::EndArray() {
+    Node node(move(get<Array>(stack_.back().container)));
+    stack_.pop_back();
+    Value(move(node));
+  }
+
+  void Builder::EndDict() {
+    Node node(move(get<Dict>(stack_.back().container)));
+    stack_.pop_back();
+    Value(move(node));
+  }
+
+  void Builder::Value(Node value) {
+    if (stack_.empty()) {
+      result_ = move(value);
+      has_result_ = true;
+    } else if (auto* array = get_if<Array>(&stack_.back().container)) {
+      array->push_back(move(value));
+    } else {
+      get<Dict>(stack_.back().container).emplace(move(stack_.back().key), move(value));
+    }
+  }
+
+  Node Builder::TakeResult() {
+    has_result_ = false;
+    return move(result_);
+  }
+
+  void ParseArray(istream& input, Handler& handler) {
+    handler.StartArray();
+    for (char c; input >> c && c != ']'; ) {
+      if (c != ',') {
+        input.putback(c);
+      }
+      Parse(input, handler);
+    }
+    handler.EndArray();
+  }
+
+  void ParseDict(istream& input, Handler& handler) {
+    handler.StartDict();
+    for (char c; input >> c && c != '}'; ) {
+      if (c == ',') {
+        input >> c;
+      }
+      string key;
+      getline(input, key, '"');
+      handler.Key(move(key));
+      input >> c;
+      Parse(input, handler);
+    }
+    handler.EndDict();
+  }
+
+  void Parse(istream& input, Handler& handler) {
+    char c;
+    input >> c;
+
+    if (c == '[') {
+      ParseArray(input, handler);
+    } else if (c == '{') {
+      ParseDict(input, handler);
+    } else if (c == '"') {
+      handler.Value(LoadString(input));
+    } else if (c == 't' || c == 'f' || c == 'n') {
+      input.putback(c);
+      handler.Value(LoadBool(input));
+    } else {
+      input.putback(c);
+      handler.Value(LoadNumber(input));
+    }
+  }
+
+  namespace {
+    // Depth 0 is outside the root, 1 is inside the root dict, 2 is inside the streamed array.
+    // Values that are not handled at these levels are collected by the builder.
+    class ArrayStreamer : public Handler {
+    public:
+      ArrayStreamer(const string& stream_key, const function<void(Node)>& on_element)
+          : stream_key_(stream_key), on_element_(on_element) {
+      }
+
+      void StartArray() override {
+        if (depth_ == 1 && !builder_.Busy() && key_ == stream_key_) {
+          depth_ = 2;
+        } else {
+          builder_.StartArray();
+        }
+      }
+
+      void EndArray() override {
+        if (depth_ == 2 && !builder_.Busy()) {
+          depth_ = 1;
+        } else {
+          builder_.EndArray();
+          Flush();
+        }
+      }
+
+      void StartDict() override {
+        if (depth_ == 0) {
+          depth_ = 1;
+        } else {
+          builder_.StartDict();
+        }
+      }
+
+      void Key(string key) override {
+        if (depth_ == 1 && !builder_.Busy()) {
+          key_ = move(key);
+        } else {
+          builder_.Key(move(key));
+        }
+      }
+
+      void EndDict() override {
+        if (depth_ == 1 && !builder_.Busy()) {
+          depth_ = 0;
+        } else {
+          builder_.EndDict();
+          Flush();
+        }
+      }
+
+      void Value(Node value) override {
+        builder_.Value(move(value));
+        Flush();
+      }
+
+      Dict TakeRest() {
+        return move(rest_);
+      }
+
+    private:
+      void Flush() {
+        if (!builder_.HasResult()) {
+          return;
+        }
+        if (depth_ == 2) {
+          on_element_(builder_.TakeResult());
+        } else {
+          rest_.emplace(key_, builder_.TakeResult());
+        }
+      }
+
+      const string& stream_key_;
+      const function<void(Node)>& on_element_;
+      Builder builder_;
+      int depth_ = 0;
+      string key_;
+      Dict rest_;
+    };
+  }
+
+  Dict StreamArray(istream& input, const string& stream_key, const function<void(Node)>& on_element) {
+    TRACE_SCOPE("Json::StreamArray");
+    ArrayStreamer streamer(stream_key, on_element);
+    Parse(input, streamer);
+    return streamer.TakeRest();
+  }
+
   template <>
   void PrintValue<string>(const string& value, ostream& output) {
     output << '"';
@@ -111,6 +296,16 @@ namespace Json {
     output << std::boolalpha << value;
   }
 
+  template <>
+  void PrintValue<nullptr_t>(const nullptr_t&, std::ostream& output) {
+    output << "null";
+  }
+
+  template <>
+  void PrintValue<Raw>(const Raw& value, std::ostream& output) {
+    output << value.json;
+  }
+
   template <>
   void PrintValue<Array>(const Array& nodes, std::ostream& output) {
     output << '[';
@@ -150,4 +345,4 @@ namespace Json {
     PrintNode(document.GetRoot(), output);
   }
 
-}
\ No newline at end of file
+}
\ No newline at end of file
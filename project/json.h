@@ -1,8 +1,11 @@
 #pragma once
 
+#include <functional>
+#include <cstddef>
 #include <iostream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -13,7 +16,12 @@ namespace Json {
   using Array = std::vector<Node>;
   using Dict = std::map<std::string, Node>;
 
-  class Node : std::variant<Array, Dict, bool, int, double, std::string> {
+  // Already printed JSON, output as is. The text must outlive the node.
+  struct Raw {
+    std::string_view json;
+  };
+
+  class Node : std::variant<Array, Dict, bool, int, double, std::string, std::nullptr_t, Raw> {
   public:
     using variant::variant;
     const variant& GetBase() const { return *this; }
@@ -62,6 +70,10 @@ namespace Json {
     const auto& AsString() const {
       return std::get<std::string>(*this);
     }
+
+    bool IsNull() const {
+      return std::holds_alternative<std::nullptr_t>(*this);
+    }
   };
 
   class Document {
@@ -78,8 +90,56 @@ namespace Json {
 
   Node LoadNode(std::istream& input);
 
+  // Sets failbit on input when it does not hold a value.
   Document Load(std::istream& input);
 
+  // Receives the events of a document read by Parse, scalars arrive as whole nodes.
+  class Handler {
+  public:
+    virtual ~Handler() = default;
+    virtual void StartArray() = 0;
+    virtual void EndArray() = 0;
+    virtual void StartDict() = 0;
+    virtual void Key(std::string key) = 0;
+    virtual void EndDict() = 0;
+    virtual void Value(Node value) = 0;
+  };
+
+  // Collects the events of one value back into a node.
+  class Builder : public Handler {
+  public:
+    void StartArray() override;
+    void EndArray() override;
+    void StartDict() override;
+    void Key(std::string key) override;
+    void EndDict() override;
+    void Value(Node value) override;
+
+    bool Busy() const {
+      return !stack_.empty();
+    }
+    bool HasResult() const {
+      return has_result_;
+    }
+    Node TakeResult();
+
+  private:
+    struct Frame {
+      std::variant<Array, Dict> container;
+      std::string key;
+    };
+    std::vector<Frame> stack_;
+    Node result_;
+    bool has_result_ = false;
+  };
+
+  // Reads the same grammar as Load without building the document.
+  void Parse(std::istream& input, Handler& handler);
+
+  // Reads a document with a dict root and passes every element of the array under stream_key to
+  // on_element as soon as it is read. The rest of the root is returned.
+  Dict StreamArray(std::istream& input, const std::string& stream_key, const std::function<void(Node)>& on_element);
+
   void PrintNode(const Node& node, std::ostream& output);
 
   template <typename Value>
@@ -93,6 +153,12 @@ namespace Json {
   template <>
   void PrintValue<bool>(const bool& value, std::ostream& output);
 
+  template <>
+  void PrintValue<std::nullptr_t>(const std::nullptr_t& value, std::ostream& output);
+
+  template <>
+  void PrintValue<Raw>(const Raw& value, std::ostream& output);
+
   template <>
   void PrintValue<Array>(const Array& nodes, std::ostream& output);
 
@@ -0,0 +1,258 @@
+#include "json_flat.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <stdexcept>
+#include <variant>
+
+#include "trace.h"
+
+using namespace std;
+
+namespace Json {
+
+  const FlatNode* FlatDict::Find(string_view key) const {
+    for (const FlatMember* member = begin_; member != end_; ++member) {
+      if (member->key == key) {
+        return &member->value;
+      }
+    }
+    return nullptr;
+  }
+
+  const FlatNode& FlatDict::at(string_view key) const {
+    if (const FlatNode* node = Find(key)) {
+      return *node;
+    }
+    throw out_of_range("no key " + string(key));
+  }
+
+  static void CheckType(bool matches) {
+    if (!matches) {
+      throw bad_variant_access();
+    }
+  }
+
+  FlatArray FlatNode::AsArray() const {
+    CheckType(IsArray());
+    return {value_.items, value_.items + size_};
+  }
+
+  FlatDict FlatNode::AsMap() const {
+    CheckType(IsMap());
+    return {value_.members, value_.members + size_};
+  }
+
+  bool FlatNode::AsBool() const {
+    CheckType(IsBool());
+    return value_.boolean;
+  }
+
+  int FlatNode::AsInt() const {
+    CheckType(IsInt());
+    return value_.integer;
+  }
+
+  double FlatNode::AsDouble() const {
+    CheckType(IsDouble());
+    return IsPureDouble() ? value_.number : value_.integer;
+  }
+
+  string_view FlatNode::AsString() const {
+    CheckType(IsString());
+    return {value_.chars, size_};
+  }
+
+  Node FlatNode::ToNode() const {
+    switch (type_) {
+      case Type::Array: {
+        Array result;
+        result.reserve(size_);
+        for (const FlatNode& item : AsArray()) {
+          result.push_back(item.ToNode());
+        }
+        return Node(move(result));
+      }
+      case Type::Dict: {
+        Dict result;
+        for (const auto& [key, value] : AsMap()) {
+          result.emplace(string(key), value.ToNode());
+        }
+        return Node(move(result));
+      }
+      case Type::Bool:
+        return Node(value_.boolean);
+      case Type::Int:
+        return Node(value_.integer);
+      case Type::Double:
+        return Node(value_.number);
+      case Type::String:
+        return Node(string(AsString()));
+      case Type::Null:
+        return Node(nullptr);
+    }
+    return Node();
+  }
+
+  FlatDocument::FlatDocument(istream& input)
+      : text_(istreambuf_iterator<char>(input), istreambuf_iterator<char>()),
+        arena_(text_.size() / 2 + 1024),
+        pos_(text_.data()),
+        end_(text_.data() + text_.size()) {
+    TRACE_SCOPE("Json::FlatDocument");
+    root_ = ParseNode();
+    values_ = {};
+    members_ = {};
+  }
+
+  // Children are collected on a shared stack while their container is parsed and moved to the
+  // arena in one piece when it is closed.
+  template <typename T>
+  const T* FlatDocument::MoveToArena(vector<T>& stack, size_t mark) {
+    const size_t count = stack.size() - mark;
+    if (count == 0) {
+      return nullptr;
+    }
+    T* result = static_cast<T*>(arena_.allocate(count * sizeof(T), alignof(T)));
+    uninitialized_copy(stack.begin() + mark, stack.end(), result);
+    stack.resize(mark);
+    return result;
+  }
+
+  void FlatDocument::SkipSpaces() {
+    while (pos_ != end_ && isspace(static_cast<unsigned char>(*pos_))) {
+      ++pos_;
+    }
+  }
+
+  FlatNode FlatDocument::ParseArray() {
+    const size_t mark = values_.size();
+    while (true) {
+      SkipSpaces();
+      if (pos_ == end_) {
+        throw invalid_argument("invalid JSON");
+      }
+      if (*pos_ == ']') {
+        ++pos_;
+        break;
+      }
+      if (*pos_ == ',') {
+        ++pos_;
+      }
+      FlatNode node = ParseNode();
+      values_.push_back(node);
+    }
+    FlatNode result;
+    result.type_ = FlatNode::Type::Array;
+    result.size_ = values_.size() - mark;
+    result.value_.items = MoveToArena(values_, mark);
+    return result;
+  }
+
+  FlatNode FlatDocument::ParseDict() {
+    const size_t mark = members_.size();
+    while (true) {
+      SkipSpaces();
+      if (pos_ == end_) {
+        throw invalid_argument("invalid JSON");
+      }
+      if (*pos_ == '}') {
+        ++pos_;
+        break;
+      }
+      if (*pos_++ == ',') {
+        SkipSpaces();
+        ++pos_;
+      }
+      const FlatNode key = ParseString();
+      SkipSpaces();
+      ++pos_;  // ':'
+      FlatNode value = ParseNode();
+      members_.push_back({key.AsString(), value});
+    }
+    FlatNode result;
+    result.type_ = FlatNode::Type::Dict;
+    result.size_ = members_.size() - mark;
+    result.value_.members = MoveToArena(members_, mark);
+    return result;
+  }
+
+  FlatNode FlatDocument::ParseString() {
+    const char* quote = find(pos_, end_, '"');
+    FlatNode result;
+    result.type_ = FlatNode::Type::String;
+    result.size_ = quote - pos_;
+    result.value_.chars = pos_;
+    pos_ = quote == end_ ? end_ : quote + 1;
+    return result;
+  }
+
+  FlatNode FlatDocument::ParseBool() {
+    const char* begin = pos_;
+    while (pos_ != end_ && isalpha(static_cast<unsigned char>(*pos_))) {
+      ++pos_;
+    }
+    const string_view word(begin, pos_ - begin);
+    FlatNode result;
+    result.type_ = word == "null" ? FlatNode::Type::Null : FlatNode::Type::Bool;
+    result.value_.boolean = word == "true";
+    return result;
+  }
+
+  // Same arithmetic as LoadNumber, so both DOMs read identical values.
+  FlatNode FlatDocument::ParseNumber() {
+    bool is_negative = false;
+    if (pos_ != end_ && *pos_ == '-') {
+      is_negative = true;
+      ++pos_;
+    }
+    if (pos_ == end_ || !isdigit(static_cast<unsigned char>(*pos_))) {
+      // Same as LoadNumber: not a value at all, so the document is rejected.
+      throw invalid_argument("invalid JSON");
+    }
+    int int_part = 0;
+    while (pos_ != end_ && isdigit(static_cast<unsigned char>(*pos_))) {
+      int_part *= 10;
+      int_part += *pos_++ - '0';
+    }
+    FlatNode result;
+    if (pos_ == end_ || *pos_ != '.') {
+      result.type_ = FlatNode::Type::Int;
+      result.value_.integer = int_part * (is_negative ? -1 : 1);
+      return result;
+    }
+    ++pos_;  // '.'
+    double number = int_part;
+    double frac_mult = 0.1;
+    while (pos_ != end_ && isdigit(static_cast<unsigned char>(*pos_))) {
+      number += frac_mult * (*pos_++ - '0');
+      frac_mult /= 10;
+    }
+    result.type_ = FlatNode::Type::Double;
+    result.value_.number = number * (is_negative ? -1 : 1);
+    return result;
+  }
+
+  FlatNode FlatDocument::ParseNode() {
+    SkipSpaces();
+    if (pos_ == end_) {
+      throw invalid_argument("invalid JSON");
+    }
+    const char c = *pos_++;
+    if (c == '[') {
+      return ParseArray();
+    } else if (c == '{') {
+      return ParseDict();
+    } else if (c == '"') {
+      return ParseString();
+    } else if (c == 't' || c == 'f' || c == 'n') {
+      --pos_;
+      return ParseBool();
+    } else {
+      --pos_;
+      return ParseNumber();
+    }
+  }
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+
+namespace Json {
+
+  class FlatArray;
+  struct FlatMember;
+  class FlatDict;
+
+  // Read-only node of a FlatDocument. Arrays and dicts point to contiguous children in the
+  // document arena, strings are views into the document text.
+  class FlatNode {
+  public:
+    enum class Type : uint8_t { Array, Dict, Bool, Int, Double, String, Null };
+
+    bool IsArray() const { return type_ == Type::Array; }
+    FlatArray AsArray() const;
+
+    bool IsMap() const { return type_ == Type::Dict; }
+    FlatDict AsMap() const;
+
+    bool IsBool() const { return type_ == Type::Bool; }
+    bool AsBool() const;
+
+    bool IsInt() const { return type_ == Type::Int; }
+    int AsInt() const;
+
+    bool IsPureDouble() const { return type_ == Type::Double; }
+    bool IsDouble() const { return IsPureDouble() || IsInt(); }
+    double AsDouble() const;
+
+    bool IsString() const { return type_ == Type::String; }
+    std::string_view AsString() const;
+
+    bool IsNull() const { return type_ == Type::Null; }
+
+    // Deep copy into the regular DOM.
+    Node ToNode() const;
+
+  private:
+    friend class FlatDocument;
+
+    Type type_ = Type::Array;
+    uint32_t size_ = 0;
+    union {
+      const FlatNode* items;
+      const FlatMember* members;
+      const char* chars;
+      bool boolean;
+      int integer;
+      double number;
+    } value_ = {nullptr};
+  };
+
+  struct FlatMember {
+    std::string_view key;
+    FlatNode value;
+  };
+
+  class FlatArray {
+  public:
+    FlatArray(const FlatNode* begin, const FlatNode* end) : begin_(begin), end_(end) {}
+
+    const FlatNode* begin() const { return begin_; }
+    const FlatNode* end() const { return end_; }
+    size_t size() const { return end_ - begin_; }
+    const FlatNode& operator[](size_t index) const { return begin_[index]; }
+
+  private:
+    const FlatNode* begin_;
+    const FlatNode* end_;
+  };
+
+  // Members keep the input order. Lookups scan them, the first member with the key wins as in
+  // Dict.
+  class FlatDict {
+  public:
+    FlatDict(const FlatMember* begin, const FlatMember* end) : begin_(begin), end_(end) {}
+
+    const FlatMember* begin() const { return begin_; }
+    const FlatMember* end() const { return end_; }
+    size_t size() const { return end_ - begin_; }
+
+    const FlatNode* Find(std::string_view key) const;
+    const FlatNode& at(std::string_view key) const;
+    size_t count(std::string_view key) const {
+      return Find(key) ? 1 : 0;
+    }
+
+  private:
+    const FlatMember* begin_;
+    const FlatMember* end_;
+  };
+
+  // Alternative to Document for big inputs. The whole input is read into one buffer and the
+  // nodes are allocated from a monotonic arena, so destruction frees a few blocks instead of
+  // every node. The grammar and the parsed values are the same as with Load. Input that Load
+  // fails the stream on throws std::invalid_argument here.
+  class FlatDocument {
+  public:
+    explicit FlatDocument(std::istream& input);
+    FlatDocument(const FlatDocument&) = delete;
+    FlatDocument& operator=(const FlatDocument&) = delete;
+
+    const FlatNode& GetRoot() const {
+      return root_;
+    }
+
+  private:
+    std::string text_;
+    std::pmr::monotonic_buffer_resource arena_;
+    FlatNode root_;
+
+    const char* pos_;
+    const char* end_;
+    std::vector<FlatNode> values_;
+    std::vector<FlatMember> members_;
+
+    void SkipSpaces();
+    FlatNode ParseNode();
+    FlatNode ParseArray();
+    FlatNode ParseDict();
+    FlatNode ParseString();
+    FlatNode ParseBool();
+    FlatNode ParseNumber();
+
+    template <typename T>
+    const T* MoveToArena(std::vector<T>& stack, size_t mark);
+  };
+
+}
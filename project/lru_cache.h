@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <utility>
+
+// Keeps the capacity most recently used values.
+template <typename Key, typename Value>
+class LruCache {
+   public:
+    explicit LruCache(size_t capacity) : capacity_(capacity) {
+    }
+
+    LruCache(const LruCache& other) : capacity_(other.capacity_), items_(other.items_) {
+        for (auto it = items_.begin(); it != items_.end(); ++it) {
+            index_[it->first] = it;
+        }
+    }
+    LruCache& operator=(const LruCache&) = delete;
+
+    const Value* Get(const Key& key) {
+        const auto it = index_.find(key);
+        if (it == index_.end()) {
+            return nullptr;
+        }
+        items_.splice(items_.begin(), items_, it->second);
+        return &it->second->second;
+    }
+
+    const Value& Put(const Key& key, Value value) {
+        if (const auto it = index_.find(key); it != index_.end()) {
+            items_.erase(it->second);
+            index_.erase(it);
+        }
+        items_.emplace_front(key, std::move(value));
+        index_[key] = items_.begin();
+        if (items_.size() > capacity_) {
+            index_.erase(items_.back().first);
+            items_.pop_back();
+        }
+        return items_.front().second;
+    }
+
+   private:
+    using Items = std::list<std::pair<Key, Value>>;
+
+    size_t capacity_;
+    Items items_;
+    std::map<Key, typename Items::iterator> index_;
+};
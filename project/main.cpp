@@ -1,9 +1,14 @@
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
 #include <string_view>
 
 #include "make_base.h"
 #include "process_requests.h"
+#include "server.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -17,20 +22,106 @@ string ReadFileData(const string& file_name) {
     return data;
 }
 
+// Options look like --name or --name=value.
+map<string_view, string_view> ParseOptions(int argc, const char* argv[]) {
+    map<string_view, string_view> options;
+    for (int i = 2; i < argc; ++i) {
+        const string_view arg(argv[i]);
+        const size_t eq = arg.find('=');
+        options[arg.substr(0, eq)] = eq == string_view::npos ? "" : arg.substr(eq + 1);
+    }
+    return options;
+}
+
+bool CheckOptions(const map<string_view, string_view>& options, const set<string_view>& known) {
+    for (const auto& [name, _] : options) {
+        if (known.count(name) == 0) {
+            cerr << "Unknown option: " << name << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// --trace=file records a timeline of the run into file, trace.json without a value.
+bool StartTrace(const map<string_view, string_view>& options) {
+    if (options.count("--trace") == 0) {
+        return false;
+    }
+    Trace::Start();
+    return true;
+}
+
+void WriteTrace(const map<string_view, string_view>& options) {
+    const string_view path = options.at("--trace");
+    ofstream file(string(path.empty() ? "trace.json" : path));
+    Trace::Write(file);
+}
+
 int main(int argc, const char* argv[]) {
-    if (argc != 2) {
-        cerr << "Usage: transport_catalog_part_o [make_base|process_requests]\n";
+    if (argc < 2) {
+        cerr << "Usage: transport_catalog_part_o [make_base [--update] [--trace[=file]]|"
+                "process_requests [--stats[=file]] [--trace[=file]]|"
+                "serve --base=file [--socket=path] [--workers=n]]\n";
         return 5;
     }
 
     const string_view mode(argv[1]);
+    const auto options = ParseOptions(argc, argv);
 
     if (mode == "make_base") {
-        MakeBase(std::cin);
+        if (!CheckOptions(options, {"--update", "--trace"})) {
+            return 5;
+        }
+        const bool trace = StartTrace(options);
+        MakeBase(std::cin, options.count("--update"));
+        if (trace) {
+            WriteTrace(options);
+        }
 
     } else if (mode == "process_requests") {
-        ProcessRequests(std::cin, std::cout);
+        if (!CheckOptions(options, {"--stats", "--trace"})) {
+            return 5;
+        }
+        const bool trace = StartTrace(options);
+        ofstream stats_file;
+        ostream* stats_output = nullptr;
+        if (const auto it = options.find("--stats"); it != options.end()) {
+            if (it->second.empty()) {
+                stats_output = &cerr;
+            } else {
+                stats_file.open(string(it->second));
+                stats_output = &stats_file;
+            }
+        }
+        try {
+            ProcessRequests(std::cin, std::cout, stats_output);
+        } catch (const invalid_argument& e) {
+            cerr << e.what() << "\n";
+            return 1;
+        }
+        if (trace) {
+            WriteTrace(options);
+        }
+
+    } else if (mode == "serve") {
+        if (!CheckOptions(options, {"--base", "--socket", "--workers"})) {
+            return 5;
+        }
+        if (!options.count("--base")) {
+            cerr << "serve needs --base=file\n";
+            return 5;
+        }
+        Server::Settings settings;
+        settings.base_file = options.at("--base");
+        if (options.count("--socket")) {
+            settings.socket_path = options.at("--socket");
+        }
+        if (options.count("--workers")) {
+            settings.workers = stoul(string(options.at("--workers")));
+        }
+        Server::Serve(settings, std::cin, std::cout);
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,6 +1,11 @@
+#include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "json.h"
@@ -8,19 +13,146 @@
 #include "transport_graph.h"
 #include "serialize.h"
 #include "render_builder.h"
+#include "task_graph.h"
 
-void MakeBase(std::istream &input) {
+// Stops and buses from delta replace the ones with the same name, entries with "remove": true drop them.
+std::vector<Json::Node> ApplyDelta(std::vector<Json::Node> base_requests, const std::vector<Json::Node> &delta) {
+    using namespace std;
+    map<pair<string, string>, size_t> positions;
+    for (size_t i = 0; i < base_requests.size(); ++i) {
+        const auto &request = base_requests[i].AsMap();
+        positions[{request.at("type").AsString(), request.at("name").AsString()}] = i;
+    }
+    vector<bool> removed(base_requests.size(), false);
+    for (const auto &node : delta) {
+        const auto &request = node.AsMap();
+        const pair<string, string> key{request.at("type").AsString(), request.at("name").AsString()};
+        const bool remove = request.count("remove") && request.at("remove").AsBool();
+        if (const auto it = positions.find(key); it != positions.end()) {
+            base_requests[it->second] = node;
+            removed[it->second] = remove;
+        } else if (!remove) {
+            positions[key] = base_requests.size();
+            base_requests.push_back(node);
+            removed.push_back(false);
+        }
+    }
+    vector<Json::Node> result;
+    result.reserve(base_requests.size());
+    for (size_t i = 0; i < base_requests.size(); ++i) {
+        if (!removed[i]) {
+            result.push_back(move(base_requests[i]));
+        }
+    }
+    return result;
+}
+
+// base_requests are streamed into the catalog while the input is read, the rest of the document
+// is kept as settings. In update mode the requests are a delta and are buffered instead.
+// The parts of the base are built on one arena, created once the settings are read.
+void MakeBase(std::istream &input, bool update = false) {
     using namespace std;
     using namespace Json;
-    Document doc = Load(input);
-    const auto &data = doc.GetRoot().AsMap();
-    const auto &in_requests = data.at("base_requests").AsArray();
-    const auto &settings = data.at("routing_settings").AsMap();
-    const auto &render_settings = data.at("render_settings").AsMap();
-    const auto &serialization_settings = data.at("serialization_settings").AsMap();
-    TransportCatalog::Catalog db(in_requests, settings);
-    TransportCatalog::TransportGraph graph(db);
-    Svg::RenderBuilder render_builder(db, render_settings);
-    Serialize::Serializator serializator(db, graph, render_builder);
-    serializator.SerializeTo(serialization_settings.at("file").AsString());
-}
\ No newline at end of file
+    Dict settings;
+    unique_ptr<google::protobuf::Arena> arena;
+    const ProtoCatalog::TransportCatalog *previous = nullptr;
+    vector<Node> delta;
+    optional<TransportCatalog::Catalog> db;
+    optional<TransportCatalog::TransportGraph> graph;
+    optional<Svg::RenderBuilder> render_builder;
+    optional<Graph::RouterBuilder::RoutesInternalData> routes;
+    optional<Graph::ExternalRouterBuilder> external_router;
+    ProtoCatalog::TransportCatalog source_part;
+    ProtoCatalog::TransportCatalog *buses_part, *stops_part, *graph_part, *router_part, *render_part;
+
+    auto file_name = [&settings]() -> const string & {
+        return settings.at("serialization_settings").AsMap().at("file").AsString();
+    };
+
+    Pipeline::TaskGraph tasks;
+    auto requests = tasks.AddTask("load", {}, [&] {
+        db.emplace();
+        settings = StreamArray(input, "base_requests", [&](Node request) {
+            if (update) {
+                delta.push_back(move(request));
+                return;
+            }
+            Serialize::SerializeSourceRequest(request.AsMap(), source_part);
+            db->AddRequest(move(request));
+        });
+        arena = Serialize::MakeArena(Serialize::GetArenaBlockSize(settings.at("serialization_settings").AsMap()));
+        for (auto *part : {&buses_part, &stops_part, &graph_part, &router_part, &render_part}) {
+            *part = google::protobuf::Arena::CreateMessage<ProtoCatalog::TransportCatalog>(arena.get());
+        }
+    });
+    if (update) {
+        const auto load = requests;
+        const auto read_base = tasks.AddTask("read_base", {load}, [&] {
+            previous = Serialize::Deserialize(file_name(), *arena);
+        });
+        requests = tasks.AddTask("delta", {read_base}, [&] {
+            for (auto &request : ApplyDelta(Serialize::LoadSource(previous->source()), delta)) {
+                Serialize::SerializeSourceRequest(request.AsMap(), source_part);
+                db->AddRequest(move(request));
+            }
+        });
+    }
+    const auto catalog = tasks.AddTask("catalog", {requests}, [&] {
+        db->Finish(settings.at("routing_settings").AsMap());
+    });
+    const auto build_graph = tasks.AddTask("graph", {catalog}, [&] {
+        graph.emplace(*db);
+    });
+    const auto layout = tasks.AddTask("layout", {catalog}, [&] {
+        render_builder.emplace(*db, settings.at("render_settings").AsMap());
+    });
+    const auto buses = tasks.AddTask("buses", {catalog}, [&] {
+        Serialize::SerializeBuses(*db, *buses_part);
+    });
+    const auto stops = tasks.AddTask("stops", {catalog}, [&] {
+        Serialize::SerializeStops(*db, *stops_part);
+        Serialize::SerializeStopsIndex(*db, *stops_part);
+    });
+    const auto graph_info = tasks.AddTask("graph_info", {build_graph}, [&] {
+        Serialize::SerializeGraphInfo(*graph, *graph_part);
+    });
+    const auto router = tasks.AddTask("router", {build_graph}, [&] {
+        const auto &routing_settings = settings.at("routing_settings").AsMap();
+        if (routing_settings.count("router_mode") && routing_settings.at("router_mode").AsString() == "hub_labels") {
+            Serialize::BuildAndSerializeHubLabels(*graph, *router_part);
+        } else if (routing_settings.count("build_memory_budget_mb")) {
+            // A table that does not fit the budget is built from scratch in a file, updates included.
+            const auto scratch_dir = routing_settings.count("scratch_dir")
+                                         ? filesystem::path(routing_settings.at("scratch_dir").AsString())
+                                         : filesystem::temp_directory_path();
+            external_router.emplace(graph->GetGraph(), size_t(routing_settings.at("build_memory_budget_mb").AsInt()) << 20, scratch_dir);
+        } else if (previous) {
+            // Times match a full build, paths of routes with equal times may not.
+            routes = Serialize::UpdateRouter(*graph, *previous);
+        } else {
+            routes = Serialize::BuildRouter(*graph);
+        }
+    });
+    const auto render = tasks.AddTask("render", {layout}, [&] {
+        Serialize::SerializeRender(*render_builder, *render_part);
+    });
+    tasks.AddTask("write", {requests, buses, stops, graph_info, router, render}, [&] {
+        auto &serializing_db = *google::protobuf::Arena::CreateMessage<ProtoCatalog::TransportCatalog>(arena.get());
+        serializing_db.mutable_buses()->swap(*buses_part->mutable_buses());
+        serializing_db.mutable_stops()->swap(*stops_part->mutable_stops());
+        serializing_db.unsafe_arena_set_allocated_stops_index(stops_part->unsafe_arena_release_stops_index());
+        serializing_db.unsafe_arena_set_allocated_graph(graph_part->unsafe_arena_release_graph());
+        serializing_db.unsafe_arena_set_allocated_hub_labels(router_part->unsafe_arena_release_hub_labels());
+        serializing_db.unsafe_arena_set_allocated_render(render_part->unsafe_arena_release_render());
+        serializing_db.set_allocated_source(source_part.release_source());
+        Serialize::SerializeMap(serializing_db);
+        if (routes) {
+            Serialize::SerializeTo(serializing_db, *graph, *routes, file_name());
+        } else if (external_router) {
+            Serialize::SerializeTo(serializing_db, *graph, *external_router, file_name());
+        } else {
+            Serialize::SerializeTo(serializing_db, file_name());
+        }
+    });
+    tasks.Run(cerr);
+}
@@ -1,31 +1,132 @@
+#include <chrono>
 #include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 
+#include "canvas.h"
 #include "executor.h"
 #include "graph.h"
 #include "json.h"
+#include "json_flat.h"
+#include "request_stats.h"
+#include "serialize.h"
 #include "transport_catalog.pb.h"
 
-ProtoCatalog::TransportCatalog Deserialize(const std::string &path) {
-    ProtoCatalog::TransportCatalog data;
-    std::ifstream file(path);
-    data.ParseFromIstream(&file);
-    file.close();
-    return data;
+// Cities built with the same render settings share one canvas style.
+class CanvasStyleCache {
+   public:
+    std::shared_ptr<const Svg::CanvasStyle> Get(const ProtoCatalog::RenderSettings &render) {
+        ProtoCatalog::RenderSettings settings = render;
+        settings.clear_stops_points();
+        settings.clear_buses_colors();
+        settings.clear_buses_points();
+        settings.clear_detail_level();
+        std::string key = settings.SerializeAsString();
+        std::lock_guard lock(mutex_);
+        auto &style = styles_[std::move(key)];
+        if (!style) {
+            style = std::make_shared<const Svg::CanvasStyle>(render);
+        }
+        return style;
+    }
+
+    size_t Size() {
+        std::lock_guard lock(mutex_);
+        return styles_.size();
+    }
+
+   private:
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<const Svg::CanvasStyle>> styles_;
+};
+
+struct City {
+    std::unique_ptr<google::protobuf::Arena> arena;
+    ProtoCatalog::TransportCatalog &db;
+    Graph::Router router;
+    Svg::Canvas canvas;
+    Executor executor;
+
+    City(const std::string &path, size_t arena_block_size, CanvasStyleCache &styles)
+        : arena(Serialize::MakeArena(arena_block_size)), db(*Serialize::Deserialize(path, *arena)), router(db),
+          canvas(db, styles.Get(db.render())), executor(db, router, canvas) {
+    }
+
+    // The canvas draws its maps on first use, so only the base is counted at load.
+    size_t MemoryUsage() const {
+        return db.SpaceUsedLong();
+    }
+};
+
+// serialization_settings holds either one "file" or a "files" dict from city key to base file.
+// With several cities every stat request names its city in "city". Every city is loaded into
+// its own arena, "arena_block_size" sets the size of its blocks.
+std::map<std::string, std::unique_ptr<City>> LoadCities(const Json::Dict &serialization_settings, CanvasStyleCache &styles) {
+    using namespace std;
+    map<string, unique_ptr<City>> cities;
+    const size_t arena_block_size = Serialize::GetArenaBlockSize(serialization_settings);
+    if (serialization_settings.count("file")) {
+        cities[""] = make_unique<City>(serialization_settings.at("file").AsString(), arena_block_size, styles);
+        return cities;
+    }
+    map<string, future<unique_ptr<City>>> loading;
+    for (const auto &[key, file] : serialization_settings.at("files").AsMap()) {
+        loading[key] = async(launch::async, [&key = key, &path = file.AsString(), arena_block_size, &styles] {
+            const auto start = chrono::steady_clock::now();
+            auto city = make_unique<City>(path, arena_block_size, styles);
+            const auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+            // Cities load concurrently, so every report goes to cerr in one write.
+            ostringstream report;
+            report << "city " << key << ": " << path << " loaded in " << ms << " ms, "
+                   << city->MemoryUsage() / 1024 << " KB\n";
+            cerr << report.str();
+            return city;
+        });
+    }
+    for (auto &[key, city] : loading) {
+        cities[key] = city.get();
+    }
+    cerr << cities.size() << " cities share " << styles.Size() << " canvas styles\n";
+    return cities;
 }
 
-void ProcessRequests(std::istream &input, std::ostream &output) {
+void ProcessRequests(std::istream &input, std::ostream &output, std::ostream *stats_output = nullptr) {
     using namespace std;
     using namespace Json;
-    Document doc = Load(input);
-    const auto &data = doc.GetRoot().AsMap();
-    const auto &out_requests = data.at("stat_requests").AsArray();
-    const auto &serialization_settings = data.at("serialization_settings").AsMap();
-    ProtoCatalog::TransportCatalog db = Deserialize(serialization_settings.at("file").AsString());
-    Graph::Router router(db);
-    Svg::Canvas canvas(db);
-    Executor executor(db, router, canvas);
+    const FlatDocument doc(input);
+    const auto data = doc.GetRoot().AsMap();
+    const auto out_requests = data.at("stat_requests").AsArray();
+    const Node serialization_settings = data.at("serialization_settings").ToNode();
+    CanvasStyleCache styles;
+    const auto cities = LoadCities(serialization_settings.AsMap(), styles);
+    RequestStats stats;
+    if (stats_output) {
+        for (const auto &[_, city] : cities) {
+            city->executor.stats = &stats;
+        }
+    }
+    vector<Node> responses;
+    responses.reserve(out_requests.size());
+    for (const auto &node : out_requests) {
+        const auto &request = node.AsMap();
+        const auto city_it = request.count("city") ? cities.find(string(request.at("city").AsString()))
+                                                   : (cities.size() == 1 ? cities.begin() : cities.end());
+        if (city_it == cities.end()) {
+            responses.push_back(Dict{{"error_message", Node("not found")}, {"request_id", Node(request.at("id").AsInt())}});
+        } else {
+            responses.push_back(city_it->second->executor.ExecuteRequest(request));
+        }
+    }
     //std::ofstream out("/home/viktor/coursera/TransportDirectoryBase/.help/result.json");
-    Json::PrintValue<std::vector<Json::Node>>(executor.ExecuteRequests(out_requests), output);
-}
\ No newline at end of file
+    Json::PrintValue<std::vector<Json::Node>>(responses, output);
+    if (stats_output) {
+        Json::PrintValue(stats.ToJson(), *stats_output);
+        *stats_output << std::endl;
+    }
+}
@@ -1,6 +1,8 @@
 #include "render_builder.h"
 #include <algorithm>
 
+#include "trace.h"
+
 using namespace TransportCatalog;
 
 namespace Svg {
@@ -57,6 +59,9 @@ RenderSettings ParseRenderSettings(const Json::Dict &json) {
     for (const auto &layer_node : layers_array) {
         result.layers.push_back(layer_node.AsString());
     }
+    if (json.count("detail_level")) {
+        result.detail_level = json.at("detail_level").AsDouble();
+    }
 
     return result;
 }
@@ -71,31 +76,36 @@ struct CompressPositions {
         double latitude;
     };
 
-    bool IsNeighbours(const Catalog::Stop *stop1, const Catalog::Stop *stop2) {
-        for (const auto &[bus, positions] : stop1->pos_in_routes) {
-            if (stop2->pos_in_routes.count(bus)) {
-                for (const auto &pos1 : positions) {
-                    for (const auto &pos2 : stop2->pos_in_routes.at(bus)) {
-                        if (std::abs(int(pos1) - int(pos2)) == 1) return true;
-                    }
+    std::vector<std::vector<size_t>> neighbours;
+
+    void ComputeNeighbours() {
+        neighbours.resize(db.StopsCount());
+        for (const auto &[_, bus] : db.GetBuses()) {
+            for (size_t i = 0; i + 1 < bus.route.size(); ++i) {
+                const size_t lhs = bus.route[i]->id, rhs = bus.route[i + 1]->id;
+                if (lhs != rhs) {
+                    neighbours[lhs].push_back(rhs);
+                    neighbours[rhs].push_back(lhs);
                 }
             }
         }
-        return false;
+        for (auto &stop_neighbours : neighbours) {
+            std::sort(stop_neighbours.begin(), stop_neighbours.end());
+            stop_neighbours.erase(std::unique(stop_neighbours.begin(), stop_neighbours.end()), stop_neighbours.end());
+        }
     }
 
-    std::map<int32_t, std::vector<const Catalog::Stop *>> Glue(std::vector<std::pair<double, const Catalog::Stop *>> &sorted) {
+    std::map<int32_t, std::vector<const Catalog::Stop *>> Glue(const std::vector<std::pair<double, const Catalog::Stop *>> &sorted) {
         std::map<int32_t, std::vector<const Catalog::Stop *>> glued;
-        std::unordered_map<std::string, int32_t> met;
+        std::vector<int32_t> met(db.StopsCount(), -1);
         for (const auto &[_, stop] : sorted) {
+            const size_t id = stop->id;
             int32_t insert = -1;
-            for (const auto &[prev_name, id] : met) {
-                if (IsNeighbours(stop, &db.GetStop(prev_name))) {
-                    insert = std::max(insert, id);
-                }
+            for (const size_t neighbour : neighbours[id]) {
+                insert = std::max(insert, met[neighbour]);
             }
             glued[++insert].push_back(stop);
-            met[stop->name] = insert;
+            met[id] = insert;
         }
         return glued;
     }
@@ -109,7 +119,7 @@ struct CompressPositions {
             size_t len = bus.end_points.second + 1;
             for (size_t j = 1; j < len; ++j) {
                 Catalog::Stop *stop = route[j];
-                if (j == 0 || j == route.size() - 1 || stop->pos_in_routes.size() > 1 || (stop->pos_in_routes[name].size() * (bus.is_rounded ? 1 : 2)) > 2) {
+                if (j == 0 || j == route.size() - 1 || db.CountStopBuses(*stop) > 1 || (db.CountStopPositions(*stop, bus) * (bus.is_rounded ? 1 : 2)) > 2) {
                     double lon_step = (stop->geo_pos.longitude - route[i]->geo_pos.longitude) / (j - i);
                     double lat_step = (stop->geo_pos.latitude - route[i]->geo_pos.latitude) / (j - i);
                     stop = route[i];
@@ -131,7 +141,7 @@ struct CompressPositions {
 
     void AddStopsWithNoBuses(std::map<std::string, StopWithUniformArrangement> &uniform_stops) {
         for (const auto &[name, stop] : db.GetStops()) {
-            if (stop.pos_in_routes.size() == 0) {
+            if (db.GetBusPositions(stop).begin() == db.GetBusPositions(stop).end()) {
                 uniform_stops[name] = {
                     stop.geo_pos.longitude,
                     stop.geo_pos.latitude};
@@ -140,6 +150,7 @@ struct CompressPositions {
     }
 
     std::map<StopName, Svg::Point> ConstructStopsPoints() {
+        TRACE_SCOPE("CompressPositions");
         if (db.StopsCount() == 0) return {};
         auto uniform_stops = ComputeUniformArrangements();
         AddStopsWithNoBuses(uniform_stops);
@@ -154,6 +165,7 @@ struct CompressPositions {
         };
         std::sort(lon_sorted.begin(), lon_sorted.end(), compare_by_double);
         std::sort(lat_sorted.begin(), lat_sorted.end(), compare_by_double);
+        ComputeNeighbours();
         auto glued_by_lon = Glue(lon_sorted);
         auto glued_by_lat = Glue(lat_sorted);
         double x_step = glued_by_lon.size() - 1 ? (settings.max_width - 2 * settings.padding) / (glued_by_lon.size() - 1) : 0.0;
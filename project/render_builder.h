@@ -20,6 +20,7 @@ struct RenderSettings {
     Svg::Point stop_label_offset;
     int stop_label_font_size;
     std::vector<std::string> layers;
+    double detail_level = 0;
 };
 
 struct RenderBuilder {
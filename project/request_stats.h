@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "json.h"
+
+// Latencies and response sizes by request type. Sizes are counted by printing every response
+// one more time, so a run with stats prints each response twice.
+class RequestStats {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    struct RouteBreakdown {
+        double path_us = 0;
+        double items_us = 0;
+        double render_us = 0;
+    };
+
+    static double MicrosecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    }
+
+    void Record(const std::string& type, double latency_us, size_t bytes) {
+        TypeStats& type_stats = by_type_[type];
+        type_stats.latencies_us.push_back(latency_us);
+        type_stats.bytes += bytes;
+    }
+
+    RouteBreakdown& Route() {
+        return route_;
+    }
+
+    // Number of bytes the node takes in the printed response.
+    static size_t PrintedSize(const Json::Node& node) {
+        CountingBuffer buffer;
+        std::ostream out(&buffer);
+        Json::PrintNode(node, out);
+        return buffer.count;
+    }
+
+    Json::Dict ToJson() const {
+        Json::Dict result;
+        for (const auto& [type, type_stats] : by_type_) {
+            std::vector<double> latencies = type_stats.latencies_us;
+            std::sort(latencies.begin(), latencies.end());
+            double total_us = 0;
+            for (const double latency : latencies) {
+                total_us += latency;
+            }
+            Json::Dict type_result{
+                {"count", Json::Node(static_cast<int>(latencies.size()))},
+                {"total_ms", Json::Node(total_us / 1000)},
+                {"p50_us", Json::Node(Percentile(latencies, 0.5))},
+                {"p90_us", Json::Node(Percentile(latencies, 0.9))},
+                {"p99_us", Json::Node(Percentile(latencies, 0.99))},
+                {"max_us", Json::Node(latencies.back())},
+                {"bytes", Json::Node(static_cast<int>(type_stats.bytes))}};
+            if (type == "Route") {
+                type_result["breakdown"] = Json::Dict{
+                    {"path_ms", Json::Node(route_.path_us / 1000)},
+                    {"items_ms", Json::Node(route_.items_us / 1000)},
+                    {"render_ms", Json::Node(route_.render_us / 1000)}};
+            }
+            result[type] = std::move(type_result);
+        }
+        return result;
+    }
+
+   private:
+    struct TypeStats {
+        std::vector<double> latencies_us;
+        size_t bytes = 0;
+    };
+
+    struct CountingBuffer : std::streambuf {
+        size_t count = 0;
+
+        int_type overflow(int_type c) override {
+            ++count;
+            return c;
+        }
+
+        std::streamsize xsputn(const char*, std::streamsize n) override {
+            count += n;
+            return n;
+        }
+    };
+
+    static double Percentile(const std::vector<double>& sorted, double rank) {
+        const size_t index = static_cast<size_t>(std::ceil(rank * sorted.size()));
+        return sorted[std::max<size_t>(index, 1) - 1];
+    }
+
+    std::map<std::string, TypeStats> by_type_;
+    RouteBreakdown route_;
+};
@@ -1,39 +1,156 @@
 #include "router.h"
 
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
 namespace Graph {
 Router::Router(const ProtoCatalog::TransportCatalog& data) : data(data) {
+    edges_from_.reserve(data.graph().edges_size());
+    for (const auto& edge : data.graph().edges()) {
+        edges_from_.push_back(edge.from());
+    }
+    if (data.has_hub_labels()) {
+        return;
+    }
+    const auto& table = data.route_table();
+    // Bases with a table over all vertices are not read, they are made again.
+    if (table.wait_vertices_size() != data.graph().vertices_size()) {
+        throw std::invalid_argument("route table is not by stops, make the base again");
+    }
+    table_rows_.assign(data.graph().vertices_size() * 2, NO_EDGE);
+    for (int row = 0; row < table.wait_vertices_size(); ++row) {
+        table_rows_[table.wait_vertices(row)] = row;
+    }
+    for (const auto& [name, vertex] : data.graph().vertices()) {
+        table_rows_[vertex.ride()] = table_rows_[vertex.wait()];
+    }
+    wait_edges_.resize(table.wait_vertices_size());
+    for (int edge_id = 0; edge_id < data.graph().edges_size(); ++edge_id) {
+        if (data.graph().edges(edge_id).is_wait_edge()) {
+            wait_edges_[table_rows_[edges_from_[edge_id]]] = edge_id;
+        }
+    }
 }
 
-std::optional<typename Router::RouteInfo> Router::BuildRoute(VertexId from, VertexId to) const {
-    const auto& route_internal_data = data.route_internal_data(from).element(to);
-    // for (size_t i = 0; i < data.route_internal_data_size(); ++i) {
-    //     for (size_t j = 0; j < data.route_internal_data(i).element_size(); ++j) {
-    //         if (data.route_internal_data(i).element(j).has_prev()) {
-    //             std::cout << "bingo";
-    //         }
-    //     }
-    // }
-    if (!route_internal_data.has_value()) {
+// The route is walked back twice over the flat arrays: once to count its edges and once to fill
+// them in from the end. Every prev edge is a bus edge, preceded in the route by the wait edge of
+// the stop it leaves.
+std::optional<double> Router::ExpandRouteByTable(VertexId from, VertexId to, std::vector<EdgeId>& edges) const {
+    const auto& table = data.route_table();
+    const size_t row = table_rows_[from] * table.vertex_count();
+    const double* weights = table.weights().data() + row;
+    const uint32_t* prev_edges = table.prev_edges().data() + row;
+    const uint32_t column = table_rows_[to];
+    if (std::isinf(weights[column])) {
         return std::nullopt;
     }
-    const double weight = route_internal_data.weight();
-    std::vector<size_t> edges;
-    if (route_internal_data.has_prev()) {
-        for (auto edge_id = route_internal_data.prev_edge();
-             data.route_internal_data(from).element(data.graph().edges(edge_id).from()).has_value();
-             edge_id = data.route_internal_data(from).element(data.graph().edges(edge_id).from()).prev_edge()) {
-            edges.push_back(edge_id);
-            if (!data.route_internal_data(from).element(data.graph().edges(edge_id).from()).has_prev()) {
-                break;
+    size_t edge_count = 0;
+    for (uint32_t edge_id = prev_edges[column]; edge_id != NO_EDGE; edge_id = prev_edges[table_rows_[edges_from_[edge_id]]]) {
+        edge_count += 2;
+    }
+    edges.resize(edge_count);
+    for (uint32_t edge_id = prev_edges[column]; edge_id != NO_EDGE; edge_id = prev_edges[table_rows_[edges_from_[edge_id]]]) {
+        edges[--edge_count] = edge_id;
+        edges[--edge_count] = wait_edges_[table_rows_[edges_from_[edge_id]]];
+    }
+    return weights[column];
+}
+
+static int FindHub(const ProtoCatalog::HubLabel& label, uint32_t hub) {
+    return std::lower_bound(label.hubs().begin(), label.hubs().end(), hub) - label.hubs().begin();
+}
+
+std::optional<double> Router::ExpandRouteByLabels(VertexId from, VertexId to, std::vector<EdgeId>& edges) const {
+    const auto& labels = data.hub_labels();
+    const auto& out_label = labels.out_labels(from);
+    const auto& in_label = labels.in_labels(to);
+    std::optional<double> weight;
+    int out_pos = 0, in_pos = 0;
+    for (int i = 0, j = 0; i < out_label.hubs_size() && j < in_label.hubs_size();) {
+        if (out_label.hubs(i) < in_label.hubs(j)) {
+            ++i;
+        } else if (out_label.hubs(i) > in_label.hubs(j)) {
+            ++j;
+        } else {
+            const double candidate = out_label.weights(i) + in_label.weights(j);
+            if (!weight || candidate < *weight) {
+                weight = candidate;
+                out_pos = i;
+                in_pos = j;
             }
+            ++i;
+            ++j;
         }
     }
-    std::reverse(std::begin(edges), std::end(edges));
+    if (!weight) {
+        return std::nullopt;
+    }
+
+    const uint32_t hub = out_label.hubs(out_pos);
+    for (uint32_t edge_id = out_label.edges(out_pos); edge_id != NO_EDGE;) {
+        edges.push_back(edge_id);
+        const auto& label = labels.out_labels(data.graph().edges(edge_id).to());
+        edge_id = label.edges(FindHub(label, hub));
+    }
+    const size_t to_hub = edges.size();
+    for (uint32_t edge_id = in_label.edges(in_pos); edge_id != NO_EDGE;) {
+        edges.push_back(edge_id);
+        const auto& label = labels.in_labels(edges_from_[edge_id]);
+        edge_id = label.edges(FindHub(label, hub));
+    }
+    std::reverse(std::begin(edges) + to_hub, std::end(edges));
+    return weight;
+}
+
+std::optional<typename Router::RouteInfo> Router::BuildRoute(VertexId from, VertexId to) const {
+    std::vector<size_t> edges;
+    const std::optional<double> weight = data.has_hub_labels() ? ExpandRouteByLabels(from, to, edges)
+                                                               : ExpandRouteByTable(from, to, edges);
+    if (!weight) {
+        return std::nullopt;
+    }
 
     const RouteId route_id = next_route_id_++;
     const size_t route_edge_count = edges.size();
     expanded_routes_cache_[route_id] = std::move(edges);
-    return RouteInfo{route_id, weight, route_edge_count};
+    return RouteInfo{route_id, *weight, route_edge_count};
+}
+
+// With labels the out label of the source is spread over hub_weights_ once, so every target
+// costs a scan of its in label instead of a merge.
+std::vector<std::optional<double>> Router::GetRouteWeights(VertexId from, const std::vector<VertexId>& targets) const {
+    std::vector<std::optional<double>> result;
+    result.reserve(targets.size());
+    if (!data.has_hub_labels()) {
+        const auto& table = data.route_table();
+        const double* weights = table.weights().data() + table_rows_[from] * table.vertex_count();
+        for (const VertexId to : targets) {
+            const double weight = weights[table_rows_[to]];
+            result.push_back(std::isinf(weight) ? std::nullopt : std::optional<double>(weight));
+        }
+        return result;
+    }
+
+    constexpr double INF = std::numeric_limits<double>::infinity();
+    const auto& labels = data.hub_labels();
+    const auto& out_label = labels.out_labels(from);
+    hub_weights_.resize(labels.out_labels_size(), INF);
+    for (int i = 0; i < out_label.hubs_size(); ++i) {
+        hub_weights_[out_label.hubs(i)] = out_label.weights(i);
+    }
+    for (const VertexId to : targets) {
+        const auto& in_label = labels.in_labels(to);
+        double weight = INF;
+        for (int j = 0; j < in_label.hubs_size(); ++j) {
+            weight = std::min(weight, hub_weights_[in_label.hubs(j)] + in_label.weights(j));
+        }
+        result.push_back(std::isinf(weight) ? std::nullopt : std::optional<double>(weight));
+    }
+    for (const uint32_t hub : out_label.hubs()) {
+        hub_weights_[hub] = INF;
+    }
+    return result;
 }
 
 EdgeId Router::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
@@ -43,4 +160,4 @@ EdgeId Router::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
 void Router::ReleaseRoute(RouteId route_id) {
     expanded_routes_cache_.erase(route_id);
 }
-}  // namespace Graph
\ No newline at end of file
+}  // namespace Graph
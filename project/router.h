@@ -1,44 +1,60 @@
-#pragma once
-
-#include <algorithm>
-#include <cassert>
-#include <cstdint>
-#include <iterator>
-#include <optional>
-#include <unordered_map>
-#include <utility>
-#include <vector>
-
-#include "graph.h"
-#include "transport_catalog.pb.h"
-
-namespace Graph {
-
-class Router {
-   private:
-    using Graph = DirectedWeightedGraph<double>;
-
-   public:
-    Router(const ProtoCatalog::TransportCatalog& data);
-
-    using RouteId = uint64_t;
-
-    struct RouteInfo {
-        RouteId id;
-        double weight;
-        size_t edge_count;
-    };
-
-    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
-    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
-    void ReleaseRoute(RouteId route_id);
-
-   private:
-    const ProtoCatalog::TransportCatalog& data;
-
-    using ExpandedRoute = std::vector<EdgeId>;
-    mutable RouteId next_route_id_ = 0;
-    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
-};
-
-}  // namespace Graph
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "transport_catalog.pb.h"
+
+namespace Graph {
+
+class Router {
+   private:
+    using Graph = DirectedWeightedGraph<double>;
+
+   public:
+    Router(const ProtoCatalog::TransportCatalog& data);
+
+    using RouteId = uint64_t;
+
+    // prev_edges entry of a route without edges.
+    static constexpr uint32_t NO_EDGE = UINT32_MAX;
+
+    struct RouteInfo {
+        RouteId id;
+        double weight;
+        size_t edge_count;
+    };
+
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    // Weights of the best routes from one vertex to every target, without expanding them.
+    std::vector<std::optional<double>> GetRouteWeights(VertexId from, const std::vector<VertexId>& targets) const;
+    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
+    void ReleaseRoute(RouteId route_id);
+
+   private:
+    const ProtoCatalog::TransportCatalog& data;
+    std::vector<uint32_t> edges_from_;
+    // The table has a row for every stop, routes go between wait vertices. Both vertices of a
+    // stop are mapped to its row, and every row to the wait edge of its stop.
+    std::vector<uint32_t> table_rows_;
+    std::vector<EdgeId> wait_edges_;
+
+    std::optional<double> ExpandRouteByTable(VertexId from, VertexId to, std::vector<EdgeId>& edges) const;
+    std::optional<double> ExpandRouteByLabels(VertexId from, VertexId to, std::vector<EdgeId>& edges) const;
+
+    // Weight to every hub from the out label of the current source, infinity elsewhere.
+    mutable std::vector<double> hub_weights_;
+
+    using ExpandedRoute = std::vector<EdgeId>;
+    mutable RouteId next_route_id_ = 0;
+    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
+};
+
+}  // namespace Graph
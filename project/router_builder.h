@@ -5,11 +5,13 @@
 #include <cstdint>
 #include <iterator>
 #include <optional>
+#include <queue>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "graph.h"
+#include "trace.h"
 
 namespace Graph {
 
@@ -18,11 +20,17 @@ struct RouterBuilder {
     
     RouterBuilder(const Graph& graph) : graph_(graph),
                                         routes_internal_data_(graph.GetVertexCount(), std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount())) {
+        TRACE_SCOPE("RouterBuilder");
         InitializeRoutesInternalData(graph);
 
+        // Progress goes to the trace about every percent of the pivots.
         const size_t vertex_count = graph.GetVertexCount();
+        const size_t progress_step = std::max<size_t>(1, vertex_count / 100);
         for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
             RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+            if (Trace::Enabled() && (vertex_through + 1) % progress_step == 0) {
+                Trace::Counter("RouterBuilder", "pivots", vertex_through + 1);
+            }
         }
     }
 
@@ -79,4 +87,79 @@ struct RouterBuilder {
     RoutesInternalData routes_internal_data_;
 };
 
+struct RouterUpdater {
+    using Graph = DirectedWeightedGraph<double>;
+    using RouteInternalData = RouterBuilder::RouteInternalData;
+    using RoutesInternalData = RouterBuilder::RoutesInternalData;
+    using Row = std::vector<std::optional<RouteInternalData>>;
+
+    // previous holds the old table renumbered to the vertices and edges of graph, without the
+    // routes that used removed edges. Stale rows are rebuilt from scratch, the others are only
+    // repaired around inserted edges. Empty rows that are not stale are not needed and stay empty.
+    // The weights are those of RouterBuilder up to the order of the sums, but of routes with equal
+    // weights a repaired row may keep another one than RouterBuilder would pick.
+    RouterUpdater(const Graph& graph, RoutesInternalData previous,
+                  const std::vector<bool>& stale_rows, const std::vector<EdgeId>& inserted_edges)
+        : graph_(graph), routes_internal_data_(std::move(previous)) {
+        for (VertexId vertex_from = 0; vertex_from < graph.GetVertexCount(); ++vertex_from) {
+            if (stale_rows[vertex_from]) {
+                RecomputeRow(vertex_from);
+            } else if (!routes_internal_data_[vertex_from].empty()) {
+                RepairRow(vertex_from, inserted_edges);
+            }
+        }
+    }
+
+    const Graph& graph_;
+
+    using Queue = std::priority_queue<std::pair<double, VertexId>,
+                                      std::vector<std::pair<double, VertexId>>,
+                                      std::greater<>>;
+
+    void Relax(Row& row, Queue& queue, EdgeId edge_id) {
+        const auto& edge = graph_.GetEdge(edge_id);
+        const double candidate_weight = row[edge.from]->weight + edge.weight;
+        auto& route_relaxing = row[edge.to];
+        if (!route_relaxing || candidate_weight < route_relaxing->weight) {
+            route_relaxing = RouteInternalData{candidate_weight, edge_id};
+            queue.push({candidate_weight, edge.to});
+        }
+    }
+
+    void Propagate(Row& row, Queue& queue) {
+        while (!queue.empty()) {
+            const auto [weight, vertex] = queue.top();
+            queue.pop();
+            if (weight > row[vertex]->weight) {
+                continue;
+            }
+            for (const EdgeId edge_id : graph_.GetIncidentEdges(vertex)) {
+                Relax(row, queue, edge_id);
+            }
+        }
+    }
+
+    void RecomputeRow(VertexId vertex_from) {
+        Row& row = routes_internal_data_[vertex_from];
+        row.assign(graph_.GetVertexCount(), std::nullopt);
+        row[vertex_from] = RouteInternalData{0, std::nullopt};
+        Queue queue;
+        queue.push({0, vertex_from});
+        Propagate(row, queue);
+    }
+
+    void RepairRow(VertexId vertex_from, const std::vector<EdgeId>& inserted_edges) {
+        Row& row = routes_internal_data_[vertex_from];
+        Queue queue;
+        for (const EdgeId edge_id : inserted_edges) {
+            if (row[graph_.GetEdge(edge_id).from]) {
+                Relax(row, queue, edge_id);
+            }
+        }
+        Propagate(row, queue);
+    }
+
+    RoutesInternalData routes_internal_data_;
+};
+
 }  // namespace Graph
@@ -1,16 +1,26 @@
 #include "serialize.h"
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
 #include <sstream>
+#include <tuple>
 
+#include "canvas.h"
+#include "hub_labels.h"
+#include "router.h"
 #include "router_builder.h"
+#include "stops_index.h"
+#include "trace.h"
 
 namespace Serialize {
-Serializator::Serializator(const TransportCatalog::Catalog& db,
-                           const TransportCatalog::TransportGraph& graph,
-                           const Svg::RenderBuilder& render)
-    : db(db), graph(graph), render(render) {}
-
-void Serializator::SerializeBuses(ProtoCatalog::TransportCatalog& data) {
+void SerializeBuses(const TransportCatalog::Catalog& db, ProtoCatalog::TransportCatalog& data) {
+    TRACE_SCOPE("Serialize::SerializeBuses");
     for (const auto& [name, body] : db.GetBuses()) {
         ProtoCatalog::Bus& response_bus = (*data.mutable_buses())[name];
         response_bus.set_name(body.name);
@@ -27,33 +37,171 @@ void Serializator::SerializeBuses(ProtoCatalog::TransportCatalog& data) {
     }
 }
 
-void Serializator::BuildAndSerializeRouter(ProtoCatalog::TransportCatalog& data) {
+// Keeps the rows and columns of wait vertices, freeing the rows of the table as it goes.
+static Graph::RouterBuilder::RoutesInternalData ToStopTable(const TransportCatalog::TransportGraph::StopVertices& stops,
+                                                            Graph::RouterBuilder::RoutesInternalData& routes) {
+    const size_t stop_count = stops.wait_vertices.size();
+    Graph::RouterBuilder::RoutesInternalData stop_routes(stop_count);
+    for (size_t from = 0; from < stop_count; ++from) {
+        auto& row = routes[stops.wait_vertices[from]];
+        stop_routes[from].reserve(stop_count);
+        for (const size_t to : stops.wait_vertices) {
+            stop_routes[from].push_back(row[to]);
+        }
+        std::vector<std::optional<Graph::RouterBuilder::RouteInternalData>>().swap(row);
+    }
+    return stop_routes;
+}
+
+// Floyd-Warshall runs over all vertices, so the weights are summed in the same order as in
+// the full table.
+Graph::RouterBuilder::RoutesInternalData BuildRouter(const TransportCatalog::TransportGraph& graph) {
     Graph::RouterBuilder router(graph.GetGraph());
-    size_t i = 0;
-    for (const auto& row : router.routes_internal_data_) {
-        ProtoCatalog::Row* new_row = data.add_route_internal_data();
-        size_t j = 0;
-        for (const auto& element : row) {
-            ProtoCatalog::RouteInternalData* new_element = new_row->add_element();
-            if (element) {
-                new_element->set_has_value(true);
-                if (element->prev_edge) {
-                    new_element->set_has_prev(true);
-                    new_element->set_prev_edge(*element->prev_edge);
-                    new_element->set_weight(element->weight);
-                } else {
-                    new_element->set_has_prev(false);
-                }
+    return ToStopTable(graph.GetStopVertices(), router.routes_internal_data_);
+}
+
+static void SerializeHubLabel(const Graph::HubLabelsBuilder::Label& label, ProtoCatalog::HubLabel& serializing_label) {
+    serializing_label.mutable_hubs()->Add(label.hubs.begin(), label.hubs.end());
+    serializing_label.mutable_weights()->Add(label.weights.begin(), label.weights.end());
+    serializing_label.mutable_edges()->Add(label.edges.begin(), label.edges.end());
+}
+
+void BuildAndSerializeHubLabels(const TransportCatalog::TransportGraph& graph, ProtoCatalog::TransportCatalog& data) {
+    TRACE_SCOPE("Serialize::BuildAndSerializeHubLabels");
+    Graph::HubLabelsBuilder labels(graph.GetGraph());
+    ProtoCatalog::HubLabels* serializing_labels = data.mutable_hub_labels();
+    for (const auto& label : labels.out_labels) {
+        SerializeHubLabel(label, *serializing_labels->add_out_labels());
+    }
+    for (const auto& label : labels.in_labels) {
+        SerializeHubLabel(label, *serializing_labels->add_in_labels());
+    }
+}
+
+using EdgeKey = std::tuple<bool, std::string, size_t, size_t>;
+
+static EdgeKey MakeEdgeKey(const TransportCatalog::TransportGraph::Edge& edge) {
+    using namespace TransportCatalog;
+    if (const auto* bus_edge = std::get_if<TransportGraph::BusEdge>(&edge)) {
+        return {false, bus_edge->bus, bus_edge->end_points.first, bus_edge->end_points.second};
+    }
+    return {true, std::get<TransportGraph::WaitEdge>(edge).stop, 0, 0};
+}
+
+static EdgeKey MakeEdgeKey(const ProtoCatalog::WaitOrBus& edge) {
+    if (edge.is_wait_edge()) {
+        return {true, edge.wait().stop(), 0, 0};
+    }
+    return {false, edge.bus().bus(), edge.bus().end_points(0), edge.bus().end_points(1)};
+}
+
+Graph::RouterBuilder::RoutesInternalData UpdateRouter(const TransportCatalog::TransportGraph& graph,
+                                                      const ProtoCatalog::TransportCatalog& previous) {
+    TRACE_SCOPE("Serialize::UpdateRouter");
+    using namespace TransportCatalog;
+    const auto& stops = graph.GetStopVertices();
+    const size_t vertex_count = graph.GetGraph().GetVertexCount();
+    const size_t stop_count = stops.wait_vertices.size();
+    const auto& previous_graph = previous.graph();
+    const auto& previous_table = previous.route_table();
+
+    std::vector<std::optional<Graph::VertexId>> vertices_map(previous_graph.vertices_size() * 2);
+    for (const auto& [name, vertex] : previous_graph.vertices()) {
+        if (const auto it = graph.vertices.find(name); it != graph.vertices.end()) {
+            vertices_map[vertex.wait()] = it->second.wait;
+            vertices_map[vertex.ride()] = it->second.ride;
+        }
+    }
+
+    std::map<EdgeKey, Graph::EdgeId> previous_edges;
+    for (int i = 0; i < previous_graph.edges_size(); ++i) {
+        previous_edges.emplace(MakeEdgeKey(previous_graph.edges(i)), i);
+    }
+    std::vector<std::optional<Graph::EdgeId>> edges_map(previous_graph.edges_size());
+    std::vector<bool> kept_edges(graph.edges.size(), false);
+    std::vector<Graph::EdgeId> inserted_edges;
+    for (Graph::EdgeId edge_id = 0; edge_id < graph.edges.size(); ++edge_id) {
+        const auto& edge = graph.GetGraph().GetEdge(edge_id);
+        const auto it = previous_edges.find(MakeEdgeKey(graph.edges[edge_id]));
+        if (it != previous_edges.end()) {
+            const auto& previous_edge = previous_graph.edges(it->second);
+            if (vertices_map[previous_edge.from()] == edge.from && vertices_map[previous_edge.to()] == edge.to &&
+                previous_edge.time() == edge.weight) {
+                edges_map[it->second] = edge_id;
+                kept_edges[edge_id] = true;
+                continue;
+            }
+        }
+        inserted_edges.push_back(edge_id);
+    }
+    // A stored route to a stop ends with a bus edge that follows the wait edge of the stop the
+    // bus leaves, so the route is kept when both edges are.
+    std::vector<std::optional<Graph::EdgeId>> ride_wait_edges(vertex_count);
+    for (const Graph::EdgeId wait_edge : stops.wait_edges) {
+        ride_wait_edges[graph.GetGraph().GetEdge(wait_edge).to] = wait_edge;
+    }
+
+    // Wait rows are taken from the previous table, and a route to a ride vertex is the route to
+    // the wait vertex of its stop followed by the wait edge. Ride rows are not stored, so they
+    // stay empty.
+    Graph::RouterBuilder::RoutesInternalData routes_internal_data(vertex_count);
+    std::vector<bool> stale_rows(vertex_count, false);
+    for (const size_t wait_vertex : stops.wait_vertices) {
+        stale_rows[wait_vertex] = true;
+    }
+    size_t stale_count = stop_count;
+    const size_t previous_stop_count = previous_table.wait_vertices_size();
+    std::vector<std::optional<Graph::VertexId>> waits_map(previous_stop_count);
+    for (size_t stop = 0; stop < previous_stop_count; ++stop) {
+        waits_map[stop] = vertices_map[previous_table.wait_vertices(stop)];
+    }
+    for (size_t from = 0; from < previous_stop_count; ++from) {
+        if (!waits_map[from]) {
+            continue;
+        }
+        auto& row = routes_internal_data[*waits_map[from]];
+        row.assign(vertex_count, std::nullopt);
+        bool stale = false;
+        for (size_t to = 0; to < previous_stop_count && !stale; ++to) {
+            const size_t index = from * previous_stop_count + to;
+            if (!waits_map[to] || std::isinf(previous_table.weights(index))) {
+                continue;
+            }
+            const uint32_t prev_edge = previous_table.prev_edges(index);
+            if (prev_edge == Graph::Router::NO_EDGE) {
+                row[*waits_map[to]] = Graph::RouterBuilder::RouteInternalData{0, std::nullopt};
+            } else if (const auto edge_id = edges_map[prev_edge];
+                       edge_id && kept_edges[*ride_wait_edges[graph.GetGraph().GetEdge(*edge_id).from]]) {
+                row[*waits_map[to]] = Graph::RouterBuilder::RouteInternalData{previous_table.weights(index), edge_id};
             } else {
-                new_element->set_has_value(false);
+                stale = true;
             }
-            ++j;
         }
-        ++i;
+        if (stale) {
+            continue;
+        }
+        for (const Graph::EdgeId wait_edge : stops.wait_edges) {
+            const auto& edge = graph.GetGraph().GetEdge(wait_edge);
+            if (row[edge.from] && kept_edges[wait_edge]) {
+                row[edge.to] = Graph::RouterBuilder::RouteInternalData{row[edge.from]->weight + edge.weight, wait_edge};
+            }
+        }
+        stale_rows[*waits_map[from]] = false;
+        --stale_count;
     }
+
+    std::cerr << "router update: " << inserted_edges.size() << " inserted edges, "
+              << stale_count << " of " << stop_count << " rows stale\n";
+    if (stale_count * 2 > stop_count) {
+        routes_internal_data.clear();
+        return BuildRouter(graph);
+    }
+    Graph::RouterUpdater router(graph.GetGraph(), std::move(routes_internal_data), stale_rows, inserted_edges);
+    return ToStopTable(stops, router.routes_internal_data_);
 }
 
-void Serializator::SerializeGraphInfo(ProtoCatalog::TransportCatalog& data) {
+void SerializeGraphInfo(const TransportCatalog::TransportGraph& graph, ProtoCatalog::TransportCatalog& data) {
+    TRACE_SCOPE("Serialize::SerializeGraphInfo");
     using namespace TransportCatalog;
     ProtoCatalog::Graph* serializing_graph = data.mutable_graph();
     for (const auto& [name, vertex] : graph.vertices) {
@@ -85,26 +233,51 @@ void Serializator::SerializeGraphInfo(ProtoCatalog::TransportCatalog& data) {
             wait->set_stop(wait_edge.stop);
         }
     }
-    BuildAndSerializeRouter(data);
 }
 
-void Serializator::SerializeStops(ProtoCatalog::TransportCatalog& data) {
+void SerializeStops(const TransportCatalog::Catalog& db, ProtoCatalog::TransportCatalog& data) {
+    TRACE_SCOPE("Serialize::SerializeStops");
     for (const auto& [name, body] : db.GetStops()) {
         ProtoCatalog::Stop& response_stop = (*data.mutable_stops())[name];
         response_stop.set_name(body.name);
-        for (const auto& [bus_name, _] : body.pos_in_routes) {
-            response_stop.add_buses(bus_name);
+        const TransportCatalog::Catalog::BusPosition* previous = nullptr;
+        for (const auto& bus_position : db.GetBusPositions(body)) {
+            if (!previous || previous->bus_id != bus_position.bus_id) {
+                response_stop.add_buses(db.GetBusById(bus_position.bus_id).name);
+            }
+            previous = &bus_position;
         }
     }
 }
 
+void SerializeStopsIndex(const TransportCatalog::Catalog& db, ProtoCatalog::TransportCatalog& data) {
+    TRACE_SCOPE("Serialize::SerializeStopsIndex");
+    struct Item {
+        const TransportCatalog::Catalog::Stop* stop;
+        Sphere::UnitVector vector;
+    };
+    std::vector<Item> items;
+    items.reserve(db.StopsCount());
+    for (const auto& [_, stop] : db.GetStops()) {
+        items.push_back({&stop, Sphere::ToUnitVector(stop.geo_pos)});
+    }
+    Sphere::BuildKdOrder(items, 0, items.size(), 0);
+    ProtoCatalog::StopsIndex& index = *data.mutable_stops_index();
+    for (const auto& [stop, _] : items) {
+        index.add_names(stop->name);
+        index.add_latitudes(stop->geo_pos.latitude);
+        index.add_longitudes(stop->geo_pos.longitude);
+    }
+}
+
 std::string ColorToStr(const Svg::Color& color) {
     std::ostringstream color_to_string;
     Svg::Render::RenderColor(color_to_string, color);
     return color_to_string.str();
 }
 
-void Serializator::SerializeRender(ProtoCatalog::TransportCatalog& data) {
+void SerializeRender(const Svg::RenderBuilder& render, ProtoCatalog::TransportCatalog& data) {
+    TRACE_SCOPE("Serialize::SerializeRender");
     ProtoCatalog::RenderSettings* serializing_render = data.mutable_render();
     const Svg::RenderSettings& settings = render.settings_;
     serializing_render->set_width(settings.max_width);
@@ -127,6 +300,7 @@ void Serializator::SerializeRender(ProtoCatalog::TransportCatalog& data) {
     for (const auto& layer : settings.layers) {
         *serializing_render->add_layers() = layer;
     }
+    serializing_render->set_detail_level(settings.detail_level);
     for (const auto& [name, point] : render.stops_points) {
         (*serializing_render->mutable_stops_points())[name].set_x(point.x);
         (*serializing_render->mutable_stops_points())[name].set_y(point.y);
@@ -134,17 +308,160 @@ void Serializator::SerializeRender(ProtoCatalog::TransportCatalog& data) {
     for (const auto& [name, color] : render.buses_colors) {
         (*serializing_render->mutable_buses_colors())[name].set_color(ColorToStr(color));
     }
+    for (const auto& [name, bus] : render.db.GetBuses()) {
+        auto& points = *(*serializing_render->mutable_buses_points())[name].mutable_points();
+        points.Reserve(bus.route.size());
+        for (const auto* stop : bus.route) {
+            const Svg::Point& point = render.stops_points.at(stop->name);
+            ProtoCatalog::Point* new_point = points.Add();
+            new_point->set_x(point.x);
+            new_point->set_y(point.y);
+        }
+    }
+}
+
+void SerializeSource(const std::vector<Json::Node>& base_requests, ProtoCatalog::TransportCatalog& data) {
+    for (const auto& node : base_requests) {
+        SerializeSourceRequest(node.AsMap(), data);
+    }
+}
+
+void SerializeSourceRequest(const Json::Dict& request, ProtoCatalog::TransportCatalog& data) {
+    ProtoCatalog::Source* source = data.mutable_source();
+    if (request.at("type").AsString() == "Stop") {
+        ProtoCatalog::SourceStop* stop = source->add_stops();
+        stop->set_name(request.at("name").AsString());
+        stop->set_latitude(request.at("latitude").AsDouble());
+        stop->set_longitude(request.at("longitude").AsDouble());
+        for (const auto& [to_stop, distance] : request.at("road_distances").AsMap()) {
+            (*stop->mutable_road_distances())[to_stop] = distance.AsInt();
+        }
+    } else if (request.at("type").AsString() == "Bus") {
+        ProtoCatalog::SourceBus* bus = source->add_buses();
+        bus->set_name(request.at("name").AsString());
+        bus->set_is_roundtrip(request.at("is_roundtrip").AsBool());
+        for (const auto& stop : request.at("stops").AsArray()) {
+            bus->add_stops(stop.AsString());
+        }
+    }
+}
+
+std::vector<Json::Node> LoadSource(const ProtoCatalog::Source& source) {
+    std::vector<Json::Node> base_requests;
+    base_requests.reserve(source.stops_size() + source.buses_size());
+    for (const auto& stop : source.stops()) {
+        Json::Dict road_distances;
+        for (const auto& [to_stop, distance] : stop.road_distances()) {
+            road_distances[to_stop] = Json::Node(distance);
+        }
+        base_requests.push_back(Json::Dict{
+            {"type", Json::Node("Stop")},
+            {"name", Json::Node(stop.name())},
+            {"latitude", Json::Node(stop.latitude())},
+            {"longitude", Json::Node(stop.longitude())},
+            {"road_distances", Json::Node(std::move(road_distances))}});
+    }
+    for (const auto& bus : source.buses()) {
+        Json::Array stops;
+        for (const auto& stop : bus.stops()) {
+            stops.emplace_back(stop);
+        }
+        base_requests.push_back(Json::Dict{
+            {"type", Json::Node("Bus")},
+            {"name", Json::Node(bus.name())},
+            {"is_roundtrip", Json::Node(bus.is_roundtrip())},
+            {"stops", Json::Node(std::move(stops))}});
+    }
+    return base_requests;
+}
+
+void SerializeMap(ProtoCatalog::TransportCatalog& data) {
+    TRACE_SCOPE("Serialize::SerializeMap");
+    data.clear_map();
+    data.clear_map_json();
+    std::string map = Svg::Canvas(data).GetDrawnMap();
+    std::ostringstream map_json;
+    Json::PrintValue(map, map_json);
+    data.set_map(std::move(map));
+    data.set_map_json(map_json.str());
+}
+
+std::unique_ptr<google::protobuf::Arena> MakeArena(size_t block_size) {
+    google::protobuf::ArenaOptions options;
+    options.start_block_size = block_size;
+    options.max_block_size = block_size;
+    return std::make_unique<google::protobuf::Arena>(options);
+}
+
+size_t GetArenaBlockSize(const Json::Dict& serialization_settings) {
+    const auto it = serialization_settings.find("arena_block_size");
+    return it == serialization_settings.end() ? DEFAULT_ARENA_BLOCK_SIZE : it->second.AsInt();
+}
+
+ProtoCatalog::TransportCatalog* Deserialize(const std::string& path, google::protobuf::Arena& arena) {
+    TRACE_SCOPE("Serialize::Deserialize");
+    auto* data = google::protobuf::Arena::CreateMessage<ProtoCatalog::TransportCatalog>(&arena);
+    std::ifstream file(path, std::ios::binary);
+    data->ParseFromIstream(&file);
+    return data;
 }
 
-void Serializator::SerializeTo(const std::string& path) {
-    ProtoCatalog::TransportCatalog serializing_db;
-    SerializeBuses(serializing_db);
-    SerializeStops(serializing_db);
-    SerializeGraphInfo(serializing_db);
-    SerializeRender(serializing_db);
+void SerializeTo(const ProtoCatalog::TransportCatalog& data, const std::string& path) {
+    TRACE_SCOPE("Serialize::SerializeTo");
     std::ofstream file(path);
-    serializing_db.SerializePartialToOstream(&file);
+    data.SerializePartialToOstream(&file);
     file.close();
 }
 
+// Messages of one type written one after another parse as their merge, and packed repeated
+// fields are appended on merge. So the table header and then every row go out as bases that
+// hold only this part of route_table, and the file reads back as one base with the whole table.
+static void SerializeTo(const ProtoCatalog::TransportCatalog& data, const TransportCatalog::TransportGraph::StopVertices& stops,
+                        const std::function<void(Graph::VertexId row, double* weights, uint32_t* prev_edges)>& fill_row,
+                        const std::string& path) {
+    TRACE_SCOPE("Serialize::SerializeTo");
+    const size_t stop_count = stops.wait_vertices.size();
+    std::ofstream file(path);
+    google::protobuf::io::OstreamOutputStream stream(&file);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    data.SerializePartialToCodedStream(&output);
+    ProtoCatalog::TransportCatalog chunk;
+    ProtoCatalog::RouteTable& table = *chunk.mutable_route_table();
+    table.set_vertex_count(stop_count);
+    table.mutable_wait_vertices()->Add(stops.wait_vertices.begin(), stops.wait_vertices.end());
+    chunk.SerializePartialToCodedStream(&output);
+    table.clear_wait_vertices();
+    table.mutable_weights()->Resize(stop_count, 0);
+    table.mutable_prev_edges()->Resize(stop_count, 0);
+    for (Graph::VertexId row = 0; row < stop_count; ++row) {
+        fill_row(row, table.mutable_weights()->mutable_data(), table.mutable_prev_edges()->mutable_data());
+        chunk.SerializePartialToCodedStream(&output);
+    }
+}
+
+void SerializeTo(const ProtoCatalog::TransportCatalog& data, const TransportCatalog::TransportGraph& graph,
+                 Graph::RouterBuilder::RoutesInternalData& routes, const std::string& path) {
+    SerializeTo(data, graph.GetStopVertices(), [&routes](Graph::VertexId row, double* weights, uint32_t* prev_edges) {
+        for (const auto& element : routes[row]) {
+            *weights++ = element ? element->weight : std::numeric_limits<double>::infinity();
+            *prev_edges++ = element && element->prev_edge ? *element->prev_edge : Graph::Router::NO_EDGE;
+        }
+        std::vector<std::optional<Graph::RouterBuilder::RouteInternalData>>().swap(routes[row]);
+    }, path);
+}
+
+void SerializeTo(const ProtoCatalog::TransportCatalog& data, const TransportCatalog::TransportGraph& graph,
+                 Graph::ExternalRouterBuilder& router, const std::string& path) {
+    const auto& stops = graph.GetStopVertices();
+    std::vector<double> row_weights(router.GetVertexCount());
+    std::vector<uint32_t> row_prev_edges(router.GetVertexCount());
+    SerializeTo(data, stops, [&](Graph::VertexId row, double* weights, uint32_t* prev_edges) {
+        router.ReadRow(stops.wait_vertices[row], row_weights.data(), row_prev_edges.data());
+        for (const size_t to : stops.wait_vertices) {
+            *weights++ = row_weights[to];
+            *prev_edges++ = row_prev_edges[to];
+        }
+    }, path);
+}
+
 }  // namespace Serialize
\ No newline at end of file
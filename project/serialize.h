@@ -1,29 +1,50 @@
+#pragma once
+
+#include <google/protobuf/arena.h>
+
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "json.h"
 #include "transport_catalog.h"
 #include "transport_catalog.pb.h"
 #include "transport_graph.h"
+#include "external_router_builder.h"
+#include "router_builder.h"
 #include "render_builder.h"
 
 namespace Serialize {
-class Serializator {
-   public:
-    Serializator(const TransportCatalog::Catalog& db,
-                 const TransportCatalog::TransportGraph& graph,
-                 const Svg::RenderBuilder& render);
-
-    void SerializeBuses(ProtoCatalog::TransportCatalog& data);
-    void SerializeStops(ProtoCatalog::TransportCatalog& data);
-    void BuildAndSerializeRouter(ProtoCatalog::TransportCatalog& data);
-    void SerializeGraphInfo(ProtoCatalog::TransportCatalog& data);
-    void SerializeRender(ProtoCatalog::TransportCatalog& data);
-    void SerializeTo(const std::string& path);
-
-   private:
-    const TransportCatalog::Catalog& db;
-    const TransportCatalog::TransportGraph& graph;
-    const Svg::RenderBuilder& render;
-};
-}
\ No newline at end of file
+void SerializeBuses(const TransportCatalog::Catalog& db, ProtoCatalog::TransportCatalog& data);
+void SerializeStops(const TransportCatalog::Catalog& db, ProtoCatalog::TransportCatalog& data);
+void SerializeStopsIndex(const TransportCatalog::Catalog& db, ProtoCatalog::TransportCatalog& data);
+// Route tables are built over all vertices and stored by stops.
+Graph::RouterBuilder::RoutesInternalData BuildRouter(const TransportCatalog::TransportGraph& graph);
+void BuildAndSerializeHubLabels(const TransportCatalog::TransportGraph& graph, ProtoCatalog::TransportCatalog& data);
+// Repairs the route table of the previous base for the new graph, or builds it anew when most
+// of it is stale. Routes of equal time may then take other paths than in a full build.
+Graph::RouterBuilder::RoutesInternalData UpdateRouter(const TransportCatalog::TransportGraph& graph,
+                                                      const ProtoCatalog::TransportCatalog& previous);
+void SerializeGraphInfo(const TransportCatalog::TransportGraph& graph, ProtoCatalog::TransportCatalog& data);
+void SerializeRender(const Svg::RenderBuilder& render, ProtoCatalog::TransportCatalog& data);
+// Renders the full map of an assembled base into it.
+void SerializeMap(ProtoCatalog::TransportCatalog& data);
+void SerializeSource(const std::vector<Json::Node>& base_requests, ProtoCatalog::TransportCatalog& data);
+void SerializeSourceRequest(const Json::Dict& request, ProtoCatalog::TransportCatalog& data);
+std::vector<Json::Node> LoadSource(const ProtoCatalog::Source& source);
+// Bases are allocated on an arena of fixed size blocks, so they are built and freed without
+// a heap allocation per message.
+inline constexpr size_t DEFAULT_ARENA_BLOCK_SIZE = 1 << 20;
+std::unique_ptr<google::protobuf::Arena> MakeArena(size_t block_size = DEFAULT_ARENA_BLOCK_SIZE);
+// Reads "arena_block_size" of serialization settings.
+size_t GetArenaBlockSize(const Json::Dict& serialization_settings);
+ProtoCatalog::TransportCatalog* Deserialize(const std::string& path, google::protobuf::Arena& arena);
+void SerializeTo(const ProtoCatalog::TransportCatalog& data, const std::string& path);
+// Writes a base without a route table followed by the table built for it. Rows are written
+// and freed one by one, so the table is never held twice.
+void SerializeTo(const ProtoCatalog::TransportCatalog& data, const TransportCatalog::TransportGraph& graph,
+                 Graph::RouterBuilder::RoutesInternalData& routes, const std::string& path);
+void SerializeTo(const ProtoCatalog::TransportCatalog& data, const TransportCatalog::TransportGraph& graph,
+                 Graph::ExternalRouterBuilder& router, const std::string& path);
+}
@@ -0,0 +1,204 @@
+#include "server.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include "canvas.h"
+#include "executor.h"
+#include "json.h"
+#include "router.h"
+#include "serialize.h"
+#include "transport_catalog.pb.h"
+
+namespace Server {
+
+namespace {
+
+class FdBuffer : public std::streambuf {
+   public:
+    explicit FdBuffer(int fd) : fd_(fd) {
+        setg(input_, input_, input_);
+        setp(output_, output_ + sizeof(output_));
+    }
+
+    ~FdBuffer() override {
+        sync();
+    }
+
+   protected:
+    int_type underflow() override {
+        const ssize_t count = read(fd_, input_, sizeof(input_));
+        if (count <= 0) {
+            return traits_type::eof();
+        }
+        setg(input_, input_, input_ + count);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    int_type overflow(int_type c) override {
+        if (sync() != 0) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        for (const char* data = pbase(); data < pptr();) {
+            const ssize_t count = send(fd_, data, pptr() - data, MSG_NOSIGNAL);
+            if (count <= 0) {
+                return -1;
+            }
+            data += count;
+        }
+        setp(output_, output_ + sizeof(output_));
+        return 0;
+    }
+
+   private:
+    int fd_;
+    char input_[1 << 16];
+    char output_[1 << 16];
+};
+
+// Router and Canvas keep per-request state, so every worker owns a copy.
+struct Worker {
+    Graph::Router router;
+    Svg::Canvas canvas;
+    Executor executor;
+
+    Worker(ProtoCatalog::TransportCatalog& data, const Svg::Canvas& prototype)
+        : router(data), canvas(prototype), executor(data, router, canvas) {
+    }
+
+    // A batch that is not valid JSON is answered with one error, and then the position in the
+    // input is lost: with skip_line the rest of the line is dropped, otherwise reading stops.
+    void ServeStream(std::istream& input, std::ostream& output, bool skip_line) {
+        while (input >> std::ws && input.peek() != std::char_traits<char>::eof()) {
+            bool parsed = false;
+            try {
+                const Json::Document doc = Json::Load(input);
+                if (input.fail()) {
+                    throw std::invalid_argument("invalid JSON");
+                }
+                parsed = true;
+                const auto& root = doc.GetRoot();
+                const auto& requests = root.IsArray() ? root.AsArray() : root.AsMap().at("stat_requests").AsArray();
+                Json::PrintValue(executor.ExecuteRequests(requests), output);
+            } catch (const std::exception& e) {
+                // Over a socket input and output are one stream, which the failed read has to
+                // leave before the error can be written.
+                input.clear();
+                Json::PrintValue(Json::Dict{{"error_message", Json::Node(std::string(e.what()))}}, output);
+            }
+            output << std::endl;
+            if (!parsed) {
+                if (!skip_line) {
+                    return;
+                }
+                input.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            }
+        }
+    }
+};
+
+class ConnectionQueue {
+   public:
+    void Push(int fd) {
+        {
+            std::lock_guard lock(mutex_);
+            fds_.push_back(fd);
+        }
+        cv_.notify_one();
+    }
+
+    int Pop() {
+        std::unique_lock lock(mutex_);
+        cv_.wait(lock, [this] { return !fds_.empty(); });
+        const int fd = fds_.front();
+        fds_.pop_front();
+        return fd;
+    }
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<int> fds_;
+};
+
+int Listen(const std::string& path) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error("socket: " + std::string(strerror(errno)));
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("socket path is too long: " + path);
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        throw std::runtime_error("bind " + path + ": " + strerror(errno));
+    }
+    return fd;
+}
+
+}  // namespace
+
+void Serve(const Settings& settings, std::istream& input, std::ostream& output) {
+    const auto arena = Serialize::MakeArena();
+    ProtoCatalog::TransportCatalog& data = *Serialize::Deserialize(settings.base_file, *arena);
+    const Svg::Canvas prototype(data);
+
+    if (settings.socket_path.empty()) {
+        Worker(data, prototype).ServeStream(input, output, true);
+        return;
+    }
+
+    const int listen_fd = Listen(settings.socket_path);
+    std::cerr << "serving " << settings.base_file << " on " << settings.socket_path
+              << " with " << settings.workers << " workers" << std::endl;
+    ConnectionQueue connections;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::max<size_t>(1, settings.workers); ++i) {
+        workers.emplace_back([&] {
+            Worker worker(data, prototype);
+            while (true) {
+                const int fd = connections.Pop();
+                {
+                    FdBuffer buffer(fd);
+                    std::iostream stream(&buffer);
+                    try {
+                        worker.ServeStream(stream, stream, false);
+                    } catch (const std::exception& e) {
+                        std::cerr << "connection dropped: " << e.what() << std::endl;
+                    }
+                }
+                close(fd);
+            }
+        });
+    }
+    while (true) {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0) {
+            connections.Push(fd);
+        }
+    }
+}
+
+}  // namespace Server
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+namespace Server {
+
+struct Settings {
+    std::string base_file;
+    std::string socket_path;
+    size_t workers = 1;
+};
+
+// Loads the base once and answers request batches until the input ends. A batch is a JSON
+// document, either an object with "stat_requests" or a bare array of requests, and is answered
+// with one line holding the JSON array of responses. Without a socket path batches are read from
+// input, otherwise every connection to the socket is a stream of batches served by a worker pool.
+// A batch that is not valid JSON is answered with an error, after which input is read from the
+// next line and a connection is closed.
+void Serve(const Settings& settings, std::istream& input, std::ostream& output);
+
+}  // namespace Server
@@ -15,13 +15,41 @@ Point Point::FromDegrees(double latitude, double longitude) {
         ConvertDegreesToRadians(longitude)};
 }
 
-const double EARTH_RADIUS = 6'371'000;
+RadianPoint RadianPoint::FromDegrees(Point point) {
+    const double latitude = ConvertDegreesToRadians(point.latitude);
+    return {sin(latitude), cos(latitude), ConvertDegreesToRadians(point.longitude)};
+}
 
 double Distance(Point lhs, Point rhs) {
-    lhs = Point::FromDegrees(lhs.latitude, lhs.longitude);
-    rhs = Point::FromDegrees(rhs.latitude, rhs.longitude);
+    return Distance(RadianPoint::FromDegrees(lhs), RadianPoint::FromDegrees(rhs));
+}
+
+double Distance(const RadianPoint& lhs, const RadianPoint& rhs) {
     return acos(
-               sin(lhs.latitude) * sin(rhs.latitude) + cos(lhs.latitude) * cos(rhs.latitude) * cos(abs(lhs.longitude - rhs.longitude))) *
+               lhs.sin_latitude * rhs.sin_latitude + lhs.cos_latitude * rhs.cos_latitude * cos(abs(lhs.longitude - rhs.longitude))) *
            EARTH_RADIUS;
 }
+
+// The terms are split into separate arrays first, so the main loop is branch-free over
+// contiguous doubles.
+vector<double> SegmentLengths(const vector<RadianPoint>& path) {
+    if (path.size() < 2) {
+        return {};
+    }
+    const size_t count = path.size() - 1;
+    vector<double> sin_latitudes(path.size()), cos_latitudes(path.size()), longitudes(path.size());
+    for (size_t i = 0; i < path.size(); ++i) {
+        sin_latitudes[i] = path[i].sin_latitude;
+        cos_latitudes[i] = path[i].cos_latitude;
+        longitudes[i] = path[i].longitude;
+    }
+    vector<double> lengths(count);
+    for (size_t i = 0; i < count; ++i) {
+        lengths[i] = sin_latitudes[i] * sin_latitudes[i + 1] + cos_latitudes[i] * cos_latitudes[i + 1] * cos(abs(longitudes[i] - longitudes[i + 1]));
+    }
+    for (size_t i = 0; i < count; ++i) {
+        lengths[i] = acos(lengths[i]) * EARTH_RADIUS;
+    }
+    return lengths;
+}
 }  // namespace Sphere
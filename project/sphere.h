@@ -1,8 +1,11 @@
 #pragma once
 
 #include <cmath>
+#include <vector>
 
 namespace Sphere {
+const double EARTH_RADIUS = 6'371'000;
+
 double ConvertDegreesToRadians(double degrees);
 
 struct Point {
@@ -12,5 +15,18 @@ struct Point {
     static Point FromDegrees(double latitude, double longitude);
 };
 
+// A point in radians with the latitude terms of Distance computed once.
+struct RadianPoint {
+    double sin_latitude;
+    double cos_latitude;
+    double longitude;
+
+    static RadianPoint FromDegrees(Point point);
+};
+
 double Distance(Point lhs, Point rhs);
+double Distance(const RadianPoint& lhs, const RadianPoint& rhs);
+
+// Distances between consecutive points of the path, equal to calling Distance for every pair.
+std::vector<double> SegmentLengths(const std::vector<RadianPoint>& path);
 }  // namespace Sphere
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "sphere.h"
+#include "transport_catalog.pb.h"
+
+namespace Sphere {
+
+using UnitVector = std::array<double, 3>;
+
+inline UnitVector ToUnitVector(Point point) {
+    const RadianPoint radians = RadianPoint::FromDegrees(point);
+    return {radians.cos_latitude * std::cos(radians.longitude),
+            radians.cos_latitude * std::sin(radians.longitude),
+            radians.sin_latitude};
+}
+
+// Stops are kept in the order of an implicit k-d tree over unit vectors: the middle element of
+// every range is its root, the split axis cycles x, y, z with depth. Euclidean distance between
+// unit vectors grows with the distance along the sphere, so the usual k-d pruning holds.
+template <typename Item>
+void BuildKdOrder(std::vector<Item>& items, size_t begin, size_t end, size_t depth) {
+    if (end - begin < 2) {
+        return;
+    }
+    const size_t middle = begin + (end - begin) / 2;
+    const size_t axis = depth % 3;
+    std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+                     [axis](const Item& lhs, const Item& rhs) { return lhs.vector[axis] < rhs.vector[axis]; });
+    BuildKdOrder(items, begin, middle, depth + 1);
+    BuildKdOrder(items, middle + 1, end, depth + 1);
+}
+
+class StopsIndex {
+   public:
+    struct Found {
+        size_t index;
+        double distance;
+    };
+
+    explicit StopsIndex(const ProtoCatalog::StopsIndex& index) : index_(index) {
+        vectors_.reserve(index.names_size());
+        for (int i = 0; i < index.names_size(); ++i) {
+            vectors_.push_back(ToUnitVector({index.latitudes(i), index.longitudes(i)}));
+        }
+    }
+
+    const std::string& GetName(size_t index) const {
+        return index_.names(index);
+    }
+
+    // Up to count stops nearest to the point, all of them within radius metres if it is given,
+    // ordered by distance.
+    std::vector<Found> FindNearest(Point point, size_t count, std::optional<double> radius) const {
+        const UnitVector query = ToUnitVector(point);
+        Search search{query, count, std::numeric_limits<double>::infinity(), {}};
+        if (radius) {
+            const double angle = std::min(*radius / EARTH_RADIUS, M_PI);
+            search.bound = 2 * std::sin(angle / 2);
+        }
+        if (count > 0) {
+            Visit(search, 0, vectors_.size(), 0);
+        }
+        std::vector<Found> result;
+        result.reserve(search.heap.size());
+        for (; !search.heap.empty(); search.heap.pop()) {
+            const size_t index = search.heap.top().second;
+            result.push_back({index, Distance(point, {index_.latitudes(index), index_.longitudes(index)})});
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+   private:
+    struct Search {
+        UnitVector query;
+        size_t count;
+        double bound;
+        std::priority_queue<std::pair<double, size_t>> heap;
+    };
+
+    void Visit(Search& search, size_t begin, size_t end, size_t depth) const {
+        if (begin == end) {
+            return;
+        }
+        const size_t middle = begin + (end - begin) / 2;
+        const UnitVector& vector = vectors_[middle];
+        const double chord = std::hypot(vector[0] - search.query[0], vector[1] - search.query[1], vector[2] - search.query[2]);
+        if (chord <= search.bound) {
+            search.heap.push({chord, middle});
+            if (search.heap.size() > search.count) {
+                search.heap.pop();
+            }
+            if (search.heap.size() == search.count) {
+                search.bound = std::min(search.bound, search.heap.top().first);
+            }
+        }
+        const double difference = search.query[depth % 3] - vector[depth % 3];
+        const auto near = difference < 0 ? std::pair{begin, middle} : std::pair{middle + 1, end};
+        const auto far = difference < 0 ? std::pair{middle + 1, end} : std::pair{begin, middle};
+        Visit(search, near.first, near.second, depth + 1);
+        if (std::abs(difference) <= search.bound) {
+            Visit(search, far.first, far.second, depth + 1);
+        }
+    }
+
+    const ProtoCatalog::StopsIndex& index_;
+    std::vector<UnitVector> vectors_;
+};
+
+}  // namespace Sphere
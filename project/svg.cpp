@@ -119,9 +119,13 @@ void Rect::Render(ostream& out) const {
 void Document::Render(ostream& out) const {
     out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>";
     out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">";
+    RenderObjects(out);
+    out << "</svg>";
+}
+
+void Document::RenderObjects(ostream& out) const {
     for (const auto& object_ptr : objects_) {
         object_ptr->Render(out);
     }
-    out << "</svg>";
 }
 }  // namespace Svg
\ No newline at end of file
@@ -173,6 +173,8 @@ class Document : public Object {
     }
 
     void Render(ostream& out) const override;
+    // The objects without the svg header and closing tag.
+    void RenderObjects(ostream& out) const;
 
    private:
     vector<shared_ptr<Object>> objects_;
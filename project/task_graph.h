@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+namespace Pipeline {
+
+using TaskId = size_t;
+
+// High-water mark of the process.
+inline long PeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Resident set of the process now.
+inline long RssKb() {
+    long pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+class TaskGraph {
+   public:
+    TaskId AddTask(std::string name, std::vector<TaskId> deps, std::function<void()> func) {
+        tasks_.push_back({std::move(name), std::move(deps), std::move(func)});
+        return tasks_.size() - 1;
+    }
+
+    void Run(std::ostream& report) {
+        using namespace std::chrono;
+        const auto start = Clock::now();
+        std::vector<std::shared_future<void>> futures;
+        futures.reserve(tasks_.size());
+        for (Task& task : tasks_) {
+            std::vector<std::shared_future<void>> deps;
+            for (const TaskId dep : task.deps) {
+                deps.push_back(futures.at(dep));
+            }
+            futures.push_back(std::async(std::launch::async, [&task, deps = std::move(deps), start] {
+                                  for (const auto& dep : deps) {
+                                      dep.get();
+                                  }
+                                  const long rss_before = RssKb();
+                                  task.begin = duration_cast<milliseconds>(Clock::now() - start).count();
+                                  {
+                                      TRACE_SCOPE(task.name);
+                                      task.func();
+                                  }
+                                  task.end = duration_cast<milliseconds>(Clock::now() - start).count();
+                                  task.rss_change_kb = RssKb() - rss_before;
+                              }).share());
+        }
+        for (const auto& future : futures) {
+            future.wait();
+        }
+        const auto total = duration_cast<milliseconds>(Clock::now() - start).count();
+        for (const auto& future : futures) {
+            future.get();
+        }
+        for (const Task& task : tasks_) {
+            report << std::left << std::setw(12) << task.name << std::right
+                   << std::setw(8) << task.end - task.begin << " ms"
+                   << "  [" << task.begin << " .. " << task.end << "]"
+                   << "  rss change " << std::showpos << task.rss_change_kb << std::noshowpos << " KB\n";
+        }
+        report << std::left << std::setw(12) << "total" << std::right
+               << std::setw(8) << total << " ms"
+               << "  peak rss " << PeakRssKb() << " KB\n";
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task {
+        std::string name;
+        std::vector<TaskId> deps;
+        std::function<void()> func;
+        long long begin = 0;
+        long long end = 0;
+        // Change of the process resident set over the task, stages running alongside included.
+        long rss_change_kb = 0;
+    };
+
+    std::vector<Task> tasks_;
+};
+
+}  // namespace Pipeline
@@ -0,0 +1,87 @@
+#include "trace.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "json.h"
+
+using namespace std;
+
+namespace Trace {
+
+namespace {
+struct Event {
+    string name;
+    char phase;
+    uint32_t thread;
+    double begin_us;
+    double duration_us;
+    string series;
+    double value;
+};
+
+mutex events_mutex;
+vector<Event> events;
+Clock::time_point start;
+atomic<uint32_t> next_thread{0};
+
+// Small numbers read better in the viewer than native thread ids.
+uint32_t ThreadNumber() {
+    thread_local const uint32_t number = next_thread++;
+    return number;
+}
+
+double MicrosecondsSinceStart(Clock::time_point time) {
+    return chrono::duration<double, micro>(time - start).count();
+}
+
+void Record(Event event) {
+    lock_guard lock(events_mutex);
+    events.push_back(move(event));
+}
+}  // namespace
+
+void Start() {
+    start = Clock::now();
+    ThreadNumber();
+    enabled.store(true, memory_order_relaxed);
+}
+
+void Complete(string_view name, Clock::time_point begin, Clock::time_point end) {
+    const double begin_us = MicrosecondsSinceStart(begin);
+    Record({string(name), 'X', ThreadNumber(), begin_us, MicrosecondsSinceStart(end) - begin_us, {}, 0});
+}
+
+void Counter(string_view name, string_view series, double value) {
+    Record({string(name), 'C', ThreadNumber(), MicrosecondsSinceStart(Clock::now()), 0, string(series), value});
+}
+
+void Write(ostream& output) {
+    Json::Array trace_events;
+    {
+        lock_guard lock(events_mutex);
+        trace_events.reserve(events.size());
+        for (const Event& event : events) {
+            Json::Dict node{
+                {"name", Json::Node(event.name)},
+                {"ph", Json::Node(string(1, event.phase))},
+                {"pid", Json::Node(0)},
+                {"tid", Json::Node(static_cast<int>(event.thread))},
+                {"ts", Json::Node(event.begin_us)},
+            };
+            if (event.phase == 'X') {
+                node["dur"] = Json::Node(event.duration_us);
+            } else {
+                node["args"] = Json::Dict{{event.series, Json::Node(event.value)}};
+            }
+            trace_events.emplace_back(move(node));
+        }
+    }
+    const auto precision = output.precision(15);
+    Json::PrintValue(Json::Dict{{"traceEvents", Json::Node(move(trace_events))}, {"displayTimeUnit", Json::Node("ms")}}, output);
+    output << '\n';
+    output.precision(precision);
+}
+
+}  // namespace Trace
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string_view>
+
+// Timeline of the work done, written in the Chrome trace event format that chrome://tracing and
+// Perfetto open. Tracing is off until Start, and a disabled scope costs one branch.
+namespace Trace {
+
+using Clock = std::chrono::steady_clock;
+
+inline std::atomic<bool> enabled{false};
+
+inline bool Enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+// Times are taken from the moment of Start.
+void Start();
+// Writes every event recorded so far, from all threads.
+void Write(std::ostream& output);
+
+// A slice of the thread timeline.
+void Complete(std::string_view name, Clock::time_point begin, Clock::time_point end);
+// A value over time, drawn as a counter track.
+void Counter(std::string_view name, std::string_view series, double value);
+
+class Scope {
+   public:
+    // The name must live until the end of the scope.
+    explicit Scope(std::string_view name) : name_(name) {
+        if (Enabled()) {
+            active_ = true;
+            begin_ = Clock::now();
+        }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+        if (active_) {
+            Complete(name_, begin_, Clock::now());
+        }
+    }
+
+   private:
+    std::string_view name_;
+    bool active_ = false;
+    Clock::time_point begin_;
+};
+
+}  // namespace Trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) ::Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
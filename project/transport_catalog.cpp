@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 
 #include "json.h"
+#include "trace.h"
 #include "transport_catalog.h"
 
 using namespace std;
@@ -15,6 +18,7 @@ void Catalog::LoadStop(const Json::Dict& data) {
     stops[name].name = name;
     stops[name].geo_pos.latitude = data.at("latitude").AsDouble();
     stops[name].geo_pos.longitude = data.at("longitude").AsDouble();
+    stops[name].geo_radians = Sphere::RadianPoint::FromDegrees(stops[name].geo_pos);
     stops[name].distances[name] = 0;
     for (const auto& [to_stop, distance] : data.at("road_distances").AsMap()) {
         stops[name].distances[to_stop] = distance.AsInt();
@@ -25,16 +29,30 @@ void Catalog::LoadStop(const Json::Dict& data) {
 }
 
 template <typename It>
-std::pair<int32_t, double> ComputeDistances(It begin, It end) {
+int32_t ComputeRouteLength(It begin, It end) {
     int32_t route_length = 0;
-    double geo_route_length = 0.0;
     for (; std::next(begin) != end; begin = std::next(begin)) {
         Stop* curr = *begin;
         Stop* next = *std::next(begin);
         route_length += curr->distances[next->name];
-        geo_route_length += Sphere::Distance(curr->geo_pos, next->geo_pos);
     }
-    return {route_length, geo_route_length};
+    return route_length;
+}
+
+// Segments are summed in the direction of travel, so the result matches adding up Distance
+// stop by stop.
+double ComputeGeoRouteLength(const std::vector<Stop*>& route, bool is_rounded) {
+    std::vector<Sphere::RadianPoint> path;
+    path.reserve(route.size());
+    for (const Stop* stop : route) {
+        path.push_back(stop->geo_radians);
+    }
+    const std::vector<double> lengths = Sphere::SegmentLengths(path);
+    double geo_route_length = std::accumulate(lengths.begin(), lengths.end(), 0.0);
+    if (!is_rounded) {
+        geo_route_length += std::accumulate(lengths.rbegin(), lengths.rend(), 0.0);
+    }
+    return geo_route_length;
 }
 
 void Catalog::LoadBus(const Json::Dict& data) {
@@ -45,39 +63,92 @@ void Catalog::LoadBus(const Json::Dict& data) {
     bus.is_rounded = data.at("is_roundtrip").AsBool();
     for (const auto& node : data.at("stops").AsArray()) {
         StopName stop_name = node.AsString();
-        Stop& stop = stops[stop_name];
         unique_cnt.insert(stop_name);
-        stop.pos_in_routes[bus_name].insert(bus.route.size());
         bus.route.push_back(&stops[stop_name]);
     }
     bus.end_points = {0, bus.route.size() - 1};
     bus.unique_stops_cnt = unique_cnt.size();
     bus.stops_cnt = (bus.is_rounded ? bus.route.size() : bus.route.size() * 2 - 1);
-    auto lengths = ComputeDistances(bus.route.begin(), bus.route.end());
-    bus.route_length = lengths.first;
-    bus.geo_route_length = lengths.second;
+    bus.route_length = ComputeRouteLength(bus.route.begin(), bus.route.end());
     if (!bus.is_rounded) {
-        lengths = ComputeDistances(bus.route.rbegin(), bus.route.rend());
-        bus.route_length += lengths.first;
-        bus.geo_route_length += lengths.second;
+        bus.route_length += ComputeRouteLength(bus.route.rbegin(), bus.route.rend());
+    }
+    bus.geo_route_length = ComputeGeoRouteLength(bus.route, bus.is_rounded);
+}
+
+Catalog::Catalog(const vector<Json::Node>& data, const Json::Dict& settings) {
+    for (const Json::Node& node : data) {
+        AddRequest(node);
+    }
+    Finish(settings);
+}
+
+void Catalog::AddRequest(Json::Node request) {
+    const auto& mapnode = request.AsMap();
+    if (mapnode.at("type").AsString() == "Stop") {
+        LoadStop(mapnode);
+    } else if (mapnode.at("type").AsString() == "Bus") {
+        pending_buses.push_back(move(request));
     }
 }
 
-Catalog::Catalog(const vector<Json::Node>& data, const Json::Dict& settings)
-    : bus_velocity(settings.at("bus_velocity").AsDouble() / 3.6), wait_time(settings.at("bus_wait_time").AsInt()) {
-    using namespace Json;
-    for (const Node& node : data) {
-        const auto& mapnode = node.AsMap();
-        if (mapnode.at("type").AsString() == "Stop") {
-            LoadStop(mapnode);
+void Catalog::Finish(const Json::Dict& settings) {
+    TRACE_SCOPE("Catalog::Finish");
+    bus_velocity = settings.at("bus_velocity").AsDouble() / 3.6;
+    wait_time = settings.at("bus_wait_time").AsInt();
+    for (const Json::Node& node : pending_buses) {
+        LoadBus(node.AsMap());
+    }
+    pending_buses.clear();
+    pending_buses.shrink_to_fit();
+    BuildBusPositions();
+}
+
+// Counting sort by stop id. Buses are visited in id order and routes from the start, so the
+// positions of every stop come out sorted.
+void Catalog::BuildBusPositions() {
+    size_t id = 0;
+    for (auto& [_, stop] : stops) {
+        stop.id = id++;
+    }
+    buses_by_id.clear();
+    stop_offsets.assign(stops.size() + 1, 0);
+    for (auto& [_, bus] : buses) {
+        bus.id = buses_by_id.size();
+        buses_by_id.push_back(&bus);
+        for (const Stop* stop : bus.route) {
+            ++stop_offsets[stop->id + 1];
+        }
+    }
+    for (size_t i = 1; i < stop_offsets.size(); ++i) {
+        stop_offsets[i] += stop_offsets[i - 1];
+    }
+    bus_positions.resize(stop_offsets.back());
+    std::vector<size_t> next(stop_offsets.begin(), stop_offsets.end() - 1);
+    for (const Bus* bus : buses_by_id) {
+        for (size_t position = 0; position < bus->route.size(); ++position) {
+            bus_positions[next[bus->route[position]->id]++] = {static_cast<uint32_t>(bus->id), static_cast<uint32_t>(position)};
         }
     }
+}
 
-    for (const Node& node : data) {
-        const auto& mapnode = node.AsMap();
-        if (mapnode.at("type").AsString() == "Bus") {
-            LoadBus(mapnode);
+size_t Catalog::CountStopBuses(const Stop& stop) const {
+    size_t count = 0;
+    const BusPosition* previous = nullptr;
+    for (const BusPosition& bus_position : GetBusPositions(stop)) {
+        if (!previous || previous->bus_id != bus_position.bus_id) {
+            ++count;
         }
+        previous = &bus_position;
     }
+    return count;
+}
+
+size_t Catalog::CountStopPositions(const Stop& stop, const Bus& bus) const {
+    const auto positions = GetBusPositions(stop);
+    const auto [first, last] = std::equal_range(
+        positions.begin(), positions.end(), BusPosition{static_cast<uint32_t>(bus.id), 0},
+        [](const BusPosition& lhs, const BusPosition& rhs) { return lhs.bus_id < rhs.bus_id; });
+    return last - first;
 }
 };  // namespace TransportCatalog
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
-#include <set>
+#include <cstdint>
+#include <map>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -17,13 +19,15 @@ using BusName = std::string;
 class Catalog {
    public:
     struct Stop {
+        size_t id;
         std::string name;
         Sphere::Point geo_pos;
+        Sphere::RadianPoint geo_radians;
         std::unordered_map<StopName, int32_t> distances;
-        std::map<BusName, std::set<size_t>> pos_in_routes;
     };
 
     struct Bus {
+        size_t id;
         std::string name;
         int32_t route_length;
         int32_t unique_stops_cnt;
@@ -34,6 +38,13 @@ class Catalog {
         std::vector<Stop*> route;
     };
 
+    // Occurrence of a stop in a bus route. Ids follow the name order of stops and buses.
+    struct BusPosition {
+        uint32_t bus_id;
+        uint32_t position;
+    };
+    using BusPositions = Range<std::vector<BusPosition>::const_iterator>;
+
     Time wait_time;
     double bus_velocity;
 
@@ -73,16 +84,40 @@ class Catalog {
         return buses[name];
     }
 
+    const Bus& GetBusById(size_t id) const {
+        return *buses_by_id[id];
+    }
+
+    // Positions of the stop in all routes, sorted by bus id and then by position.
+    BusPositions GetBusPositions(const Stop& stop) const {
+        return {bus_positions.begin() + stop_offsets[stop.id], bus_positions.begin() + stop_offsets[stop.id + 1]};
+    }
+
+    size_t CountStopBuses(const Stop& stop) const;
+    size_t CountStopPositions(const Stop& stop, const Bus& bus) const;
+
     Catalog(const std::vector<Json::Node>& data, const Json::Dict& settings);
     Catalog(const Catalog&) = delete;
 
+    // Streaming construction: requests come one by one in input order, stops are loaded at once
+    // and buses are kept until Finish, when all the stops they refer to are known.
+    Catalog() = default;
+    void AddRequest(Json::Node request);
+    void Finish(const Json::Dict& settings);
+
    private:
     std::map<std::string, Stop> stops;
     std::map<std::string, Bus> buses;
+    std::vector<const Bus*> buses_by_id;
+    std::vector<size_t> stop_offsets;
+    std::vector<BusPosition> bus_positions;
+    std::vector<Json::Node> pending_buses;
 
     void LoadStop(const Json::Dict& data);
 
     void LoadBus(const Json::Dict& data);
+
+    void BuildBusPositions();
 };
 
 };  // namespace TransportCatalog
@@ -5,6 +5,7 @@
 
 #include "graph.h"
 #include "router.h"
+#include "trace.h"
 #include "transport_catalog.h"
 
 namespace TransportCatalog {
@@ -50,16 +51,30 @@ class TransportGraph {
         return graph;
     }
 
+    // Wait vertex and wait edge of every stop, by stop id. Routes between stops go from wait
+    // vertex to wait vertex, so route tables keep the rows and columns of these vertices only.
+    struct StopVertices {
+        std::vector<size_t> wait_vertices;
+        std::vector<::Graph::EdgeId> wait_edges;
+    };
+
+    inline const StopVertices& GetStopVertices() const {
+        return stop_vertices;
+    }
+
    private:
     const Catalog& transport_db;
     Graph graph;
+    StopVertices stop_vertices;
 
     void BuildGraph() {
+        TRACE_SCOPE("TransportGraph::BuildGraph");
         const auto& stops = transport_db.GetStops();
         size_t cnt = 0;
         for (const auto& [name, _] : stops) {
             vertices[name] = {name, cnt, cnt + 1};
-            graph.AddEdge({cnt, cnt + 1, transport_db.wait_time});
+            stop_vertices.wait_vertices.push_back(cnt);
+            stop_vertices.wait_edges.push_back(graph.AddEdge({cnt, cnt + 1, transport_db.wait_time}));
             edges.push_back(Edge(WaitEdge{name, cnt, cnt + 1, transport_db.wait_time}));
             cnt += 2;
         }
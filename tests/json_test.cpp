@@ -0,0 +1,57 @@
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.h"
+#include "json_flat.h"
+#include "test_runner.h"
+
+using namespace std;
+
+// Both parsers have to reject the same malformed batches: Load by failing the stream,
+// FlatDocument by throwing.
+void TestMalformedBatches() {
+    const vector<string> batches = {
+        "xx",
+        "[xx",
+        R"({"stat_requests": [{"id": 1, "type": "Map"}, xx]})",
+        R"({"stat_requests": [{"id": -, "type": "Map"}]})",
+        R"({"stat_requests": [)",
+    };
+    for (const string& batch : batches) {
+        istringstream stream_input(batch);
+        Json::Load(stream_input);
+        CHECK(stream_input.fail());
+
+        istringstream flat_input(batch);
+        bool thrown = false;
+        try {
+            Json::FlatDocument doc(flat_input);
+        } catch (const invalid_argument&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+}
+
+void TestWellFormedBatch() {
+    const string batch = R"({"stat_requests": [{"id": -12, "type": "Map", "x": 2.5, "render": true, "y": null}]})";
+    istringstream stream_input(batch);
+    const Json::Document doc = Json::Load(stream_input);
+    CHECK(!stream_input.fail());
+    istringstream flat_input(batch);
+    const Json::FlatDocument flat_doc(flat_input);
+
+    ostringstream printed, flat_printed;
+    Json::PrintNode(doc.GetRoot(), printed);
+    Json::PrintNode(flat_doc.GetRoot().ToNode(), flat_printed);
+    CHECK_EQUAL(flat_printed.str(), printed.str());
+    CHECK_EQUAL(doc.GetRoot().AsMap().at("stat_requests").AsArray()[0].AsMap().at("id").AsInt(), -12);
+}
+
+int main() {
+    TestMalformedBatches();
+    TestWellFormedBatch();
+    return Test::Failures();
+}
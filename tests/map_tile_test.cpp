@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <string>
+
+#include "test_city.h"
+#include "test_runner.h"
+
+using namespace std;
+using Json::Node;
+
+Json::Dict TileRequest(int id, Json::Dict params) {
+    params["id"] = Node(id);
+    params["type"] = Node("MapTile");
+    return params;
+}
+
+bool IsInvalidTile(const Node& response) {
+    const auto& dict = response.AsMap();
+    return dict.count("error_message") && dict.at("error_message").AsString() == "invalid tile" && !dict.count("map");
+}
+
+
+void TestTileRequests() {
+    const string base_file = Test::TempBasePath("map_tile_test");
+    Test::RunMakeBase(Benchmark::GenerateCity({20, 5, 6, 0.5, 0, 1}, base_file).make_base);
+
+    const Json::Array valid = {
+        Node(TileRequest(0, {{"zoom", Node(0)}, {"x", Node(0)}, {"y", Node(0)}})),
+        Node(TileRequest(1, {{"zoom", Node(2)}, {"x", Node(3)}, {"y", Node(1)}})),
+        Node(TileRequest(2, {{"zoom", Node(30)}, {"x", Node(0)}, {"y", Node(0)}})),
+        Node(TileRequest(3, {{"viewport", Node(Json::Array{Node(0), Node(0), Node(600.5), Node(400)})}})),
+    };
+    for (const Node& request : valid) {
+        const string response = Test::RunProcessRequests(Test::MakeRequests(base_file, {request}));
+        CHECK_EQUAL(response.rfind(R"([{"map": "<?xml)", 0), size_t{0});
+        CHECK(response.find("error_message") == string::npos);
+    }
+
+    const Json::Array invalid = {
+        Node(TileRequest(0, {{"zoom", Node(70)}, {"x", Node(0)}, {"y", Node(0)}})),
+        Node(TileRequest(1, {{"zoom", Node(31)}, {"x", Node(0)}, {"y", Node(0)}})),
+        Node(TileRequest(2, {{"zoom", Node(-1)}, {"x", Node(0)}, {"y", Node(0)}})),
+        Node(TileRequest(3, {{"zoom", Node(1)}, {"x", Node(2)}, {"y", Node(0)}})),
+        Node(TileRequest(4, {{"zoom", Node(1)}, {"x", Node(0)}, {"y", Node(-1)}})),
+        Node(TileRequest(5, {{"zoom", Node(1)}, {"x", Node(0)}})),
+        Node(TileRequest(6, {{"zoom", Node(1.5)}, {"x", Node(0)}, {"y", Node(0)}})),
+        Node(TileRequest(7, {{"viewport", Node(Json::Array{Node(0), Node(0), Node(10)})}})),
+        Node(TileRequest(8, {{"viewport", Node(Json::Array{Node(0), Node(0), Node(10), Node(10), Node(20)})}})),
+        Node(TileRequest(9, {{"viewport", Node(Json::Array{Node(0), Node("0"), Node(10), Node(10)})}})),
+        Node(TileRequest(10, {{"viewport", Node(Json::Array{Node(10), Node(0), Node(0), Node(10)})}})),
+        Node(TileRequest(11, {{"viewport", Node(5)}})),
+        Node(TileRequest(12, {})),
+    };
+    const Json::Array responses = Test::ParseResponses(Test::RunProcessRequests(Test::MakeRequests(base_file, invalid)));
+    CHECK_EQUAL(responses.size(), invalid.size());
+    for (size_t i = 0; i < responses.size(); ++i) {
+        if (!IsInvalidTile(responses[i])) {
+            Test::Fail(__FILE__, __LINE__, "request " + to_string(i) + " is not rejected");
+        }
+        CHECK_EQUAL(responses[i].AsMap().at("request_id").AsInt(), static_cast<int>(i));
+    }
+    remove(base_file.c_str());
+}
+
+int main() {
+    TestTileRequests();
+    return Test::Failures();
+}
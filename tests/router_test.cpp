@@ -0,0 +1,104 @@
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <optional>
+#include <string>
+
+#include "test_city.h"
+#include "test_runner.h"
+
+using namespace std;
+using Json::Node;
+
+Node RouteRequest(int id, const string& from, const string& to) {
+    return Node(Json::Dict{{"id", Node(id)}, {"type", Node("Route")}, {"from", Node(from)}, {"to", Node(to)}});
+}
+
+// Weights of routes as the release before the table by stops printed them. The table by stops
+// once summed the wait time into every hop and moved these in the last digit.
+void TestRoutesMatchBaseline() {
+    const string base_file = Test::TempBasePath("router_test");
+    Test::RunMakeBase(Benchmark::GenerateCity({300, 75, 10, 0.5, 0, 1}, base_file).make_base);
+
+    // Responses hold route maps, so they are checked as printed.
+    const string responses = Test::RunProcessRequests(Test::MakeRequests(base_file, {
+        RouteRequest(0, "Stop 55", "Stop 248"),
+        RouteRequest(1, "Stop 20", "Stop 282"),
+    }));
+    CHECK(responses.find(R"("request_id": 0, "total_time": 101.597})") != string::npos);
+    CHECK(responses.find(R"("request_id": 1, "total_time": 106.268})") != string::npos);
+    remove(base_file.c_str());
+}
+
+// Total time of every response by request id, nullopt for routes not found. Route responses
+// hold maps, so they are read from the printed output.
+map<int, optional<double>> TotalTimes(const string& responses) {
+    map<int, optional<double>> times;
+    const string id_key = R"("request_id": )", time_key = R"(, "total_time": )";
+    for (size_t pos = responses.find(id_key); pos != string::npos; pos = responses.find(id_key, pos + 1)) {
+        size_t length = 0;
+        const int id = stoi(responses.substr(pos + id_key.size(), 16), &length);
+        const size_t time_pos = pos + id_key.size() + length;
+        times[id] = responses.compare(time_pos, time_key.size(), time_key) == 0
+                        ? optional<double>(stod(responses.substr(time_pos + time_key.size(), 32)))
+                        : nullopt;
+    }
+    return times;
+}
+
+// An updated table has the weights of a full build, but routes of equal time may take other
+// paths, and the weights may be summed in another order. So only the printed times are compared.
+void TestUpdateMatchesRebuild() {
+    const string updated_file = Test::TempBasePath("router_test_updated");
+    const string rebuilt_file = Test::TempBasePath("router_test_rebuilt");
+    Json::Node make_base = Benchmark::GenerateCity({64, 16, 8, 0.5, 0, 3}, updated_file).make_base;
+    Test::RunMakeBase(make_base);
+
+    // A copy of bus 0 ties with it on every route it serves, and bus 1 goes away.
+    const auto& base_requests = make_base.AsMap().at("base_requests").AsArray();
+    Json::Dict copy;
+    for (const Node& request : base_requests) {
+        if (request.AsMap().at("type").AsString() == "Bus" && request.AsMap().at("name").AsString() == "0") {
+            copy = request.AsMap();
+        }
+    }
+    copy["name"] = Node("0 copy");
+    const Json::Array delta{
+        Node(copy),
+        Node(Json::Dict{{"type", Node("Bus")}, {"name", Node("1")}, {"remove", Node(true)}}),
+    };
+    Json::Dict update = make_base.AsMap();
+    update["base_requests"] = Node(delta);
+    Test::RunMakeBase(Node(update), true);
+
+    Json::Dict rebuild = make_base.AsMap();
+    rebuild["serialization_settings"] = Node(Json::Dict{{"file", Node(rebuilt_file)}});
+    rebuild["base_requests"] = Node(ApplyDelta(base_requests, delta));
+    Test::RunMakeBase(Node(rebuild));
+
+    Json::Array routes;
+    for (int from = 0; from < 64; from += 4) {
+        for (int to = 0; to < 64; to += 4) {
+            routes.push_back(RouteRequest(static_cast<int>(routes.size()), "Stop " + to_string(from), "Stop " + to_string(to)));
+        }
+    }
+    const auto updated = TotalTimes(Test::RunProcessRequests(Test::MakeRequests(updated_file, routes)));
+    const auto rebuilt = TotalTimes(Test::RunProcessRequests(Test::MakeRequests(rebuilt_file, routes)));
+    CHECK_EQUAL(updated.size(), routes.size());
+    CHECK_EQUAL(rebuilt.size(), routes.size());
+    for (const auto& [id, time] : rebuilt) {
+        const auto it = updated.find(id);
+        if (it == updated.end() || it->second.has_value() != time.has_value() ||
+            (time && std::abs(*it->second - *time) > 1e-5 * std::max(1.0, *time))) {
+            Test::Fail(__FILE__, __LINE__, "route " + to_string(id) + " differs after the update");
+        }
+    }
+    remove(updated_file.c_str());
+    remove(rebuilt_file.c_str());
+}
+
+int main() {
+    TestRoutesMatchBaseline();
+    TestUpdateMatchesRebuild();
+    return Test::Failures();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+
+#include "city_generator.h"
+#include "json.h"
+#include "make_base.h"
+#include "process_requests.h"
+
+// make_base and process_requests run in process over documents built by the test.
+namespace Test {
+
+inline std::string TempBasePath(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / (name + "_" + std::to_string(getpid()) + ".bin")).string();
+}
+
+inline std::string Print(const Json::Node& node) {
+    std::ostringstream output;
+    Json::PrintNode(node, output);
+    return output.str();
+}
+
+inline void RunMakeBase(const Json::Node& document, bool update = false) {
+    std::istringstream input(Print(document));
+    MakeBase(input, update);
+}
+
+// Printed responses to the stat_requests of the document.
+inline std::string RunProcessRequests(const Json::Node& document) {
+    std::istringstream input(Print(document));
+    std::ostringstream output;
+    ProcessRequests(input, output);
+    return output.str();
+}
+
+// Json::Load does not unescape strings, so only responses without maps read back as printed.
+inline Json::Array ParseResponses(const std::string& responses) {
+    std::istringstream input(responses);
+    return Json::Load(input).GetRoot().AsArray();
+}
+
+inline Json::Node MakeRequests(const std::string& base_file, Json::Array stat_requests) {
+    return Json::Dict{
+        {"serialization_settings", Json::Node(Json::Dict{{"file", Json::Node(base_file)}})},
+        {"stat_requests", Json::Node(std::move(stat_requests))}};
+}
+
+}  // namespace Test
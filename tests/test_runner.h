@@ -0,0 +1,39 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Checks for the test executables. A failed check is reported and counted, and main returns
+// the count, so ctest marks the executable as failed.
+namespace Test {
+
+inline int& Failures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline void Fail(const char* file, int line, const std::string& message) {
+    std::cerr << file << ":" << line << ": " << message << "\n";
+    ++Failures();
+}
+
+}  // namespace Test
+
+#define CHECK(condition)                                                 \
+    do {                                                                 \
+        if (!(condition)) {                                              \
+            ::Test::Fail(__FILE__, __LINE__, "check failed: " #condition); \
+        }                                                                \
+    } while (false)
+
+#define CHECK_EQUAL(actual, expected)                                                             \
+    do {                                                                                          \
+        const auto& actual_value = (actual);                                                      \
+        const auto& expected_value = (expected);                                                  \
+        if (!(actual_value == expected_value)) {                                                  \
+            std::ostringstream message;                                                           \
+            message << #actual " is " << actual_value << ", expected " << expected_value;         \
+            ::Test::Fail(__FILE__, __LINE__, message.str());                                      \
+        }                                                                                         \
+    } while (false)